@@ -0,0 +1,131 @@
+// Contention on the loaded-chunk map as loader threads are added. Build it
+// with the "Build chunk grid benchmark" task; it needs no window or GL
+// context.
+//
+// Each load does what a load task does under chunk_map_mutex: publish the
+// chunk, then look up its six neighbors to link them. Three maps are timed:
+//   locked hash map   an unordered_map, written under an exclusive lock;
+//   exclusive grid    ChunkGrid, still inserting under an exclusive lock;
+//   atomic grid       ChunkGrid inserting under a shared lock, as
+//                     WorldManager does.
+#include "chunkGrid.hpp"
+#include "chunkPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Window around the origin, in chunks: a render distance of 36 with the
+// game's vertical band.
+const glm::ivec3 BELOW(36, 6, 36);
+const glm::ivec3 ABOVE(36, 9, 36);
+const int REPEATS = 3;
+const glm::ivec3 NEIGHBOR_OFFSETS[6] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                                        {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+
+typedef std::unordered_map<glm::ivec3, Chunk *, ChunkPositionHash> ChunkMap;
+
+struct LockedMap {
+  ChunkMap map;
+  std::shared_mutex mutex;
+
+  int load(Chunk *chunk) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    map[chunk->chunkPosition] = chunk;
+    int linked = 0;
+    for (const glm::ivec3 &offset : NEIGHBOR_OFFSETS)
+      linked += map.count(chunk->chunkPosition + offset) != 0;
+    return linked;
+  }
+};
+
+template <bool EXCLUSIVE_INSERT> struct Grid {
+  ChunkGrid grid{BELOW, ABOVE};
+  std::shared_mutex mutex;
+
+  Grid() { grid.setOrigin(glm::ivec3(0)); }
+
+  int load(Chunk *chunk) {
+    if (EXCLUSIVE_INSERT) {
+      std::unique_lock<std::shared_mutex> lock(mutex);
+      return insertAndLink(chunk);
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return insertAndLink(chunk);
+  }
+
+  int insertAndLink(Chunk *chunk) {
+    grid.insert(chunk);
+    int linked = 0;
+    for (const glm::ivec3 &offset : NEIGHBOR_OFFSETS)
+      linked += grid.get(chunk->chunkPosition + offset) != nullptr;
+    return linked;
+  }
+};
+
+// Average ns per load with the chunks split across threadCount threads,
+// over REPEATS fresh maps. links counts the neighbors found, so the work
+// can't be optimized out.
+template <typename Map>
+double timeLoads(const std::vector<Chunk *> &chunks, int threadCount,
+                 std::atomic<long> &links) {
+  double seconds = 0.0;
+  for (int repeat = 0; repeat < REPEATS; ++repeat) {
+    Map map;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+      threads.emplace_back([&, t]() {
+        long found = 0;
+        for (size_t i = t; i < chunks.size(); i += threadCount)
+          found += map.load(chunks[i]);
+        links.fetch_add(found, std::memory_order_relaxed);
+      });
+    }
+    for (std::thread &thread : threads)
+      thread.join();
+    seconds += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  }
+  return seconds * 1e9 / ((double)REPEATS * chunks.size());
+}
+
+} // namespace
+
+int main() {
+  glm::ivec3 extent = BELOW + ABOVE + 1;
+  size_t count = (size_t)extent.x * extent.y * extent.z;
+  ChunkPool pool(count);
+  std::vector<ChunkStateFlags> flags(count);
+  std::vector<Chunk *> chunks;
+  for (int x = -BELOW.x; x <= ABOVE.x; ++x)
+    for (int y = -BELOW.y; y <= ABOVE.y; ++y)
+      for (int z = -BELOW.z; z <= ABOVE.z; ++z)
+        chunks.push_back(pool.acquire(glm::ivec3(x, y, z),
+                                      (uint32_t)chunks.size(),
+                                      flags[chunks.size()]));
+
+  std::printf("%zu loads of insert + 6 neighbor lookups, %u hardware "
+              "threads\n",
+              chunks.size(), std::thread::hardware_concurrency());
+  std::printf("threads  locked hash map  exclusive grid  atomic grid\n");
+  std::atomic<long> links{0};
+  for (int threadCount : {1, 2, 4, 8, 16, 32}) {
+    double locked = timeLoads<LockedMap>(chunks, threadCount, links);
+    double exclusive = timeLoads<Grid<true>>(chunks, threadCount, links);
+    double atomic = timeLoads<Grid<false>>(chunks, threadCount, links);
+    std::printf("%7d  %12.0f ns  %11.0f ns  %8.0f ns\n", threadCount, locked,
+                exclusive, atomic);
+  }
+
+  for (Chunk *chunk : chunks)
+    pool.release(chunk);
+  return links.load() > 0 ? 0 : 1;
+}
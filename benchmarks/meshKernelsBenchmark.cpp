@@ -0,0 +1,182 @@
+// Times the face-mask kernels (see meshKernels.hpp) against each other, and
+// whole-chunk meshing with each one active. Build it with the "Build mesh
+// kernel benchmark" task; it needs no window or GL context.
+//
+// The sample chunks are heightfield terrain in the game's height range plus
+// one dense random chunk, which has faces on every z slice and so is the
+// z kernels' worst case. Before timing, every kernel's masks and every
+// kernel's meshes are checked against the scalar ones.
+#include "chunk.hpp"
+#include "meshKernels.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Sample {
+  std::unique_ptr<ChunkStateFlags> flags;
+  std::unique_ptr<Chunk> chunk;
+  std::unique_ptr<ChunkMeshInput> input;
+};
+
+const MeshKernelIsa ISAS[] = {MeshKernelIsa::SCALAR, MeshKernelIsa::SSE41,
+                              MeshKernelIsa::AVX2};
+// (d, direction) of each face, in Voxel::VoxelFace order.
+const int FACES[6][2] = {{2, 1}, {2, -1}, {1, 1}, {1, -1}, {0, 1}, {0, -1}};
+
+float terrainHeight(float worldX, float worldZ) {
+  float total = 0.0f, amplitude = 1.0f, frequency = 0.01f, maxValue = 0.0f;
+  for (int octave = 0; octave < 4; ++octave) {
+    total += glm::simplex(glm::vec2(worldX, worldZ) * frequency) * amplitude;
+    maxValue += amplitude;
+    amplitude *= 0.5f;
+    frequency *= 2.0f;
+  }
+  return ((total / maxValue + 1.0f) / 2.0f) * MAX_HEIGHT;
+}
+
+Sample makeSample(const glm::ivec3 &position, const ChunkVoxels &voxels) {
+  Sample sample;
+  sample.flags = std::make_unique<ChunkStateFlags>();
+  sample.chunk = std::make_unique<Chunk>(position, 0, *sample.flags);
+  sample.chunk->publishVoxels(ChunkVoxels(voxels));
+  sample.chunk->setKeepMeshData(true);
+
+  ChunkMeshSources sources;
+  sample.chunk->gatherMeshSources(sources);
+  sample.input = std::make_unique<ChunkMeshInput>();
+  Chunk::captureMeshInput(sources, *sample.input);
+  return sample;
+}
+
+// Non-uniform terrain chunks from a patch of the heightfield; uniform ones
+// mesh without the kernels.
+void addTerrainSamples(std::vector<Sample> &samples) {
+  for (int cx = -4; cx < 4; ++cx) {
+    for (int cz = -4; cz < 4; ++cz) {
+      for (int cy = 0; cy * CHUNK_HEIGHT < MAX_HEIGHT; ++cy) {
+        ChunkVoxels voxels;
+        for (int x = 0; x < CHUNK_WIDTH; ++x) {
+          for (int z = 0; z < CHUNK_DEPTH; ++z) {
+            int height = (int)terrainHeight((float)(cx * CHUNK_WIDTH + x),
+                                            (float)(cz * CHUNK_DEPTH + z));
+            for (int y = 0; y < CHUNK_HEIGHT; ++y)
+              if (cy * CHUNK_HEIGHT + y < height)
+                voxels.set(ChunkVoxels::toIndex(x, y, z), 1);
+          }
+        }
+        if (!voxels.isUniform())
+          samples.push_back(makeSample(glm::ivec3(cx, cy, cz), voxels));
+      }
+    }
+  }
+}
+
+Sample makeRandomSample() {
+  std::mt19937 rng(1234);
+  ChunkVoxels voxels;
+  for (int i = 0; i < CHUNK_VOLUME; ++i)
+    if (rng() & 1)
+      voxels.set(i, 1);
+  return makeSample(glm::ivec3(0), voxels);
+}
+
+bool masksMatch(const std::vector<Sample> &samples, MeshKernelIsa isa) {
+  FaceMaskKernel scalar = MeshKernels::getFaceMaskKernel(MeshKernelIsa::SCALAR);
+  FaceMaskKernel kernel = MeshKernels::getFaceMaskKernel(isa);
+  static ChunkColumn expected[CHUNK_DEPTH][CHUNK_DEPTH];
+  static ChunkColumn actual[CHUNK_DEPTH][CHUNK_DEPTH];
+  for (const Sample &sample : samples) {
+    for (const int *face : FACES) {
+      scalar(sample.input->columns, face[0], face[1], expected);
+      kernel(sample.input->columns, face[0], face[1], actual);
+      if (std::memcmp(expected, actual, sizeof(expected)) != 0)
+        return false;
+    }
+  }
+  return true;
+}
+
+// Average ns per chunk for the faces in [firstFace, lastFace).
+double timeMasks(const std::vector<Sample> &samples, MeshKernelIsa isa,
+                 int firstFace, int lastFace, int repeats) {
+  FaceMaskKernel kernel = MeshKernels::getFaceMaskKernel(isa);
+  static ChunkColumn masks[CHUNK_DEPTH][CHUNK_DEPTH];
+  auto start = std::chrono::steady_clock::now();
+  for (int repeat = 0; repeat < repeats; ++repeat)
+    for (const Sample &sample : samples)
+      for (int face = firstFace; face < lastFace; ++face)
+        kernel(sample.input->columns, FACES[face][0], FACES[face][1], masks);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / ((double)repeats * samples.size());
+}
+
+// Full remesh of every sample with isa active, input capture included;
+// average us per chunk. The meshes are left in the chunks for comparison.
+double timeMeshing(std::vector<Sample> &samples, MeshKernelIsa isa,
+                   int repeats) {
+  MeshKernels::setActiveIsa(isa);
+  auto start = std::chrono::steady_clock::now();
+  for (int repeat = 0; repeat < repeats; ++repeat) {
+    for (Sample &sample : samples) {
+      sample.chunk->setMeshNeedsUpdate();
+      sample.chunk->generateMesh(*sample.input);
+    }
+  }
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / ((double)repeats * samples.size());
+}
+
+std::vector<std::vector<Voxel::PackedVoxel>>
+copyMeshes(const std::vector<Sample> &samples) {
+  std::vector<std::vector<Voxel::PackedVoxel>> meshes;
+  for (const Sample &sample : samples)
+    meshes.push_back(sample.chunk->getMeshData());
+  return meshes;
+}
+
+} // namespace
+
+int main() {
+  std::vector<Sample> terrain;
+  addTerrainSamples(terrain);
+  std::vector<Sample> random;
+  random.push_back(makeRandomSample());
+  std::printf("%d^3 chunks: %zu terrain samples, 1 random; best kernel %s\n",
+              CHUNK_SIZE, terrain.size(),
+              MeshKernels::getIsaName(MeshKernels::getBestIsa()));
+
+  timeMeshing(terrain, MeshKernelIsa::SCALAR, 1);
+  const auto scalarMeshes = copyMeshes(terrain);
+
+  for (MeshKernelIsa isa : ISAS) {
+    const char *name = MeshKernels::getIsaName(isa);
+    if (!MeshKernels::isSupported(isa)) {
+      std::printf("%-7s not supported on this CPU\n", name);
+      continue;
+    }
+    if (!masksMatch(terrain, isa) || !masksMatch(random, isa)) {
+      std::printf("%-7s masks differ from the scalar kernel's\n", name);
+      return 1;
+    }
+    timeMeshing(terrain, isa, 1);
+    if (copyMeshes(terrain) != scalarMeshes) {
+      std::printf("%-7s meshes differ from the scalar kernel's\n", name);
+      return 1;
+    }
+
+    double allFaces = timeMasks(terrain, isa, 0, 6, 200);
+    double zFaces = timeMasks(random, isa, 0, 2, 20000);
+    double mesh = timeMeshing(terrain, isa, 20);
+    std::printf("%-7s face masks %7.2f us/chunk, random z faces %7.2f us, "
+                "whole mesh %7.2f us/chunk\n",
+                name, allFaces / 1000.0, zFaces / 1000.0, mesh);
+  }
+  return 0;
+}
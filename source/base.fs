@@ -2,6 +2,7 @@
 out vec4 FragColor;
 
 flat in int fsColor;
+in float fsOcclusion;
 
 const vec3 colorPalette[8] = vec3[8](
     vec3(1.0, 0.0, 0.0), // Red
@@ -17,5 +18,5 @@ const vec3 colorPalette[8] = vec3[8](
 
 void main()
 {
-    FragColor = vec4(colorPalette[(fsColor - 1) % 8], 1.0);
+    FragColor = vec4(colorPalette[(fsColor - 1) % 8] * fsOcclusion, 1.0);
 }
\ No newline at end of file
@@ -1,20 +1,26 @@
 #version 410 core
-layout (location = 0) in uint vertexData;    // Per-vertex: local pos, dimensions, color, face
+layout (location = 0) in uint vertexData;    // Per-vertex: local pos, dimensions, color
 
 uniform uint instanceData;                   // Per-instance: chunk pos
+uniform uint face;                           // Per-draw: face of this quad group
 uniform mat4 view;
 uniform mat4 projection;
 
 flat out int fsColor;
+out float fsOcclusion;
 
-// Vertex data unpacking (32-bit)
-#define GET_X(data) (((data) >> 0u) & 0xFu)
-#define GET_Y(data) (((data) >> 4u) & 0xFu)
-#define GET_Z(data) (((data) >> 8u) & 0xFu)
-#define GET_LENGTH(data) ((((data) >> 12u) & 0xFu) + 1u)
-#define GET_HEIGHT(data) ((((data) >> 16u) & 0xFu) + 1u)
-#define GET_COLOR(data) (((data) >> 20u) & 0xFFu)
-#define GET_FACING(data) (((data) >> 28u) & 0x7u)
+// Vertex data unpacking (32-bit). CHUNK_SIZE and the VERTEX_* layout
+// constants are #defined by the host from voxel.hpp.
+#define COORD_MASK ((1u << VERTEX_COORD_BITS) - 1u)
+#define GET_X(data) (((data) >> 0u) & COORD_MASK)
+#define GET_Y(data) (((data) >> VERTEX_COORD_BITS) & COORD_MASK)
+#define GET_Z(data) (((data) >> (2u * VERTEX_COORD_BITS)) & COORD_MASK)
+#define GET_LENGTH(data) ((((data) >> (3u * VERTEX_COORD_BITS)) & COORD_MASK) + 1u)
+#define GET_HEIGHT(data) ((((data) >> (4u * VERTEX_COORD_BITS)) & COORD_MASK) + 1u)
+#define GET_COLOR(data) (((data) >> VERTEX_COLOR_SHIFT) & VERTEX_COLOR_MASK)
+// Baked occlusion of quad corner 2 * uEnd + vEnd: 3 = open, 0 = darkest.
+// Builds without room for it (VERTEX_AO_BITS == 0) draw every corner open.
+#define GET_AO(data, corner) (VERTEX_AO_BITS == 0u ? 3u : (((data) >> (VERTEX_AO_SHIFT + 2u * (corner))) & 3u))
 
 // Instance data unpacking (32-bit)
 #define GET_CHUNK_X(data) ((((data) >> 0u) & 0x3FFu) - 512u)
@@ -42,6 +48,21 @@ const vec3 cubeFaces[24] = vec3[24](
     vec3(-0.5, 0.5, 0.5), vec3(-0.5, -0.5, 0.5)
 );
 
+// Brightness for each occlusion level.
+const float occlusionBrightness[4] = float[4](0.45, 0.65, 0.82, 1.0);
+
+// Strip order that splits the quad along vertices 0-3 instead of 1-2; it
+// walks the same outline, so the winding is unchanged.
+const int flippedStrip[4] = int[4](1, 3, 0, 2);
+
+// Occlusion level of strip vertex i of this face. uvAxes are the quad's u
+// and v axes, which pick the corner out of the vertex position.
+float cornerOcclusion(uint data, int i, ivec2 uvAxes) {
+    vec3 corner = cubeFaces[int(face) * 4 + i] + 0.5;
+    uint index = uint(corner[uvAxes.x]) * 2u + uint(corner[uvAxes.y]);
+    return float(GET_AO(data, index));
+}
+
 void main() {
     // Unpack vertex data
     int x      = int(GET_X(vertexData));
@@ -50,7 +71,6 @@ void main() {
     int length = int(GET_LENGTH(vertexData));
     int height = int(GET_HEIGHT(vertexData));
     int color  = int(GET_COLOR(vertexData));
-    int face   = int(GET_FACING(vertexData));
     
     // Unpack instance data
     int chunkX = int(GET_CHUNK_X(instanceData));
@@ -58,34 +78,49 @@ void main() {
     int chunkZ = int(GET_CHUNK_Z(instanceData));
 
     vec3 voxelPosition = vec3(x, y, z);
-    vec3 worldPosition = voxelPosition + (ivec3(chunkX, chunkY, chunkZ) * ivec3(16, 16, 16));
+    vec3 worldPosition = voxelPosition + (ivec3(chunkX, chunkY, chunkZ) * ivec3(CHUNK_SIZE));
 
     float lengthV = float(length);
     float heightU = float(height);
     
     vec3 scale = vec3(1.0);
+    ivec2 uvAxes;
     
     // Face ordering: FRONT=0, BACK=1, TOP=2, BOTTOM=3, RIGHT=4, LEFT=5
     // For each face: d=depth axis, u=height axis, v=length axis
-    if (face == 0 || face == 1) {
+    if (face == 0u || face == 1u) {
         // FRONT/BACK: d=2(Z), u=0(X), v=1(Y)
         // height expands in u(X), length expands in v(Y)
         scale = vec3(heightU, lengthV, 1.0);
+        uvAxes = ivec2(0, 1);
         fsColor = 1;
-    } else if (face == 2 || face == 3) {
+    } else if (face == 2u || face == 3u) {
         // TOP/BOTTOM: d=1(Y), u=0(X), v=2(Z)
         // height expands in u(X), length expands in v(Z)
         scale = vec3(heightU, 1.0, lengthV);
+        uvAxes = ivec2(0, 2);
         fsColor = 2;
     } else {
         // LEFT/RIGHT: d=0(X), u=1(Y), v=2(Z)
         // height expands in u(Y), length expands in v(Z)
         scale = vec3(1.0, heightU, lengthV);
+        uvAxes = ivec2(1, 2);
         fsColor = 3;
     }
 
-    int index = face * 4;
+    int index = int(face) * 4;
     int vertexIndex = gl_VertexID % 4;
+
+    // Occlusion is interpolated across each triangle, so split the quad
+    // along the diagonal whose corners agree more; a lone dark (or lit)
+    // corner then shades its own triangle instead of streaking across.
+    float ao[4] = float[4](cornerOcclusion(vertexData, 0, uvAxes),
+                           cornerOcclusion(vertexData, 1, uvAxes),
+                           cornerOcclusion(vertexData, 2, uvAxes),
+                           cornerOcclusion(vertexData, 3, uvAxes));
+    if (abs(ao[0] - ao[3]) < abs(ao[1] - ao[2]))
+        vertexIndex = flippedStrip[vertexIndex];
+    fsOcclusion = occlusionBrightness[int(ao[vertexIndex])];
     vec3 localVertex = cubeFaces[index + vertexIndex] + 0.5;
     
     vec3 worldVertex = worldPosition + localVertex * scale;
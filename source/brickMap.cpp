@@ -0,0 +1,149 @@
+#include "brickMap.hpp"
+#include <algorithm>
+
+std::atomic<size_t> BrickMap::totalMemoryUsage{0};
+
+BrickMap::BrickMap(const ChunkVoxels &voxels) {
+  if (voxels.isUniform()) {
+    palette.assign(1, voxels.getUniformID());
+    totalMemoryUsage.fetch_add(getMemoryUsage(), std::memory_order_relaxed);
+    return;
+  }
+
+  // Gather every brick's voxels, column by column.
+  uint8_t brick[BRICK_COUNT][BRICK_VOLUME];
+  uint8_t column[CHUNK_DEPTH];
+  for (int x = 0; x < CHUNK_WIDTH; ++x) {
+    for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+      voxels.decodeColumn(x, y, column);
+      for (int z = 0; z < CHUNK_DEPTH; ++z)
+        brick[toBrick(x, y, z)][toBrickVoxel(x, y, z)] = column[z];
+    }
+  }
+
+  int paletteIndex[256];
+  std::fill(paletteIndex, paletteIndex + 256, -1);
+  for (int b = 0; b < BRICK_COUNT; ++b) {
+    for (int i = 0; i < BRICK_VOLUME; ++i) {
+      uint8_t voxelID = brick[b][i];
+      if (paletteIndex[voxelID] < 0) {
+        paletteIndex[voxelID] = (int)palette.size();
+        palette.push_back(voxelID);
+      }
+    }
+  }
+
+  // Edits can leave a non-uniform ChunkVoxels holding a single ID.
+  if (palette.size() == 1) {
+    totalMemoryUsage.fetch_add(getMemoryUsage(), std::memory_order_relaxed);
+    return;
+  }
+
+  bitsPerVoxel = 1;
+  while ((1u << bitsPerVoxel) < palette.size())
+    bitsPerVoxel *= 2;
+
+  headers.reset(new uint16_t[BRICK_COUNT]);
+  bool mixed[BRICK_COUNT];
+  for (int b = 0; b < BRICK_COUNT; ++b) {
+    mixed[b] = false;
+    for (int i = 1; i < BRICK_VOLUME && !mixed[b]; ++i)
+      mixed[b] = brick[b][i] != brick[b][0];
+    mixedCount += mixed[b];
+  }
+
+  words.reset(new uint64_t[(size_t)mixedCount * bitsPerVoxel]());
+  int next = 0;
+  for (int b = 0; b < BRICK_COUNT; ++b) {
+    if (!mixed[b]) {
+      headers[b] = brick[b][0];
+      continue;
+    }
+
+    headers[b] = MIXED_BRICK | (uint16_t)next;
+    uint64_t *brickWords = &words[(size_t)next * bitsPerVoxel];
+    for (int i = 0; i < BRICK_VOLUME; ++i) {
+      uint64_t value =
+          bitsPerVoxel == 8 ? brick[b][i] : (uint64_t)paletteIndex[brick[b][i]];
+      int bitOffset = i * bitsPerVoxel;
+      brickWords[bitOffset >> 6] |= value << (bitOffset & 63);
+    }
+    ++next;
+  }
+
+  if (bitsPerVoxel == 8) {
+    palette.clear();
+    palette.shrink_to_fit();
+  }
+  totalMemoryUsage.fetch_add(getMemoryUsage(), std::memory_order_relaxed);
+}
+
+BrickMap::~BrickMap() {
+  totalMemoryUsage.fetch_sub(getMemoryUsage(), std::memory_order_relaxed);
+}
+
+size_t BrickMap::getMemoryUsage() const {
+  size_t bytes = palette.capacity();
+  if (headers) {
+    bytes += BRICK_COUNT * sizeof(uint16_t);
+    bytes += (size_t)mixedCount * bitsPerVoxel * sizeof(uint64_t);
+  }
+  return bytes;
+}
+
+uint8_t BrickMap::getMixed(int mixedIndex, int brickVoxel) const {
+  int bitOffset = brickVoxel * bitsPerVoxel;
+  uint64_t word = words[(size_t)mixedIndex * bitsPerVoxel + (bitOffset >> 6)];
+  uint8_t value = (word >> (bitOffset & 63)) & ((1u << bitsPerVoxel) - 1);
+  return bitsPerVoxel == 8 ? value : palette[value];
+}
+
+uint8_t BrickMap::get(int x, int y, int z) const {
+  if (!headers)
+    return palette[0];
+
+  uint16_t header = headers[toBrick(x, y, z)];
+  if (!(header & MIXED_BRICK))
+    return (uint8_t)header;
+  return getMixed(header & ~MIXED_BRICK, toBrickVoxel(x, y, z));
+}
+
+ChunkVoxels BrickMap::toVoxels() const {
+  if (!headers)
+    return ChunkVoxels(palette[0]);
+
+  // Start from air and skip all-air bricks; uniform bricks go in a column
+  // run at a time, and the palette grows as the other IDs show up.
+  ChunkVoxels voxels;
+  for (int bx = 0; bx < BRICKS_PER_AXIS; ++bx) {
+    for (int by = 0; by < BRICKS_PER_AXIS; ++by) {
+      for (int bz = 0; bz < BRICKS_PER_AXIS; ++bz) {
+        uint16_t header = headers[(bx * BRICKS_PER_AXIS + by) * BRICKS_PER_AXIS + bz];
+        if (header == 0)
+          continue;
+
+        if (!(header & MIXED_BRICK)) {
+          ChunkColumn run = (ChunkColumn)(((1u << BRICK_SIZE) - 1)
+                                          << (bz * BRICK_SIZE));
+          for (int x = bx * BRICK_SIZE; x < (bx + 1) * BRICK_SIZE; ++x) {
+            for (int y = by * BRICK_SIZE; y < (by + 1) * BRICK_SIZE; ++y)
+              voxels.setColumn(x, y, run, (uint8_t)header);
+          }
+          continue;
+        }
+
+        int i = 0;
+        for (int x = bx * BRICK_SIZE; x < (bx + 1) * BRICK_SIZE; ++x) {
+          for (int y = by * BRICK_SIZE; y < (by + 1) * BRICK_SIZE; ++y) {
+            for (int z = bz * BRICK_SIZE; z < (bz + 1) * BRICK_SIZE; ++z, ++i) {
+              uint8_t voxelID = getMixed(header & ~MIXED_BRICK, i);
+              if (voxelID != 0)
+                voxels.set(ChunkVoxels::toIndex(x, y, z), voxelID);
+            }
+          }
+        }
+      }
+    }
+  }
+  return voxels;
+}
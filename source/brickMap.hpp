@@ -0,0 +1,77 @@
+#pragma once
+
+#include "chunkVoxels.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Sparse brick encoding of one chunk's voxels, for far-field chunks that
+// only need their voxels again to remesh or once the camera comes close.
+//
+// The chunk is cut into 4x4x4 bricks. A brick whose 64 voxels share one ID
+// costs just its header entry; only mixed bricks store voxels, packed at the
+// smallest width (1, 2, 4 or 8 bits) that fits the chunk's distinct IDs. At
+// 8 bits mixed bricks hold voxel IDs directly, otherwise palette indices.
+// Unlike ChunkVoxels there is no occupancy bitset and no full-chunk array,
+// so air and solid interiors cost nothing.
+class BrickMap {
+public:
+  static constexpr int BRICK_SIZE = 4;
+  static constexpr int BRICK_VOLUME = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+  static constexpr int BRICKS_PER_AXIS = CHUNK_SIZE / BRICK_SIZE;
+  static constexpr int BRICK_COUNT =
+      BRICKS_PER_AXIS * BRICKS_PER_AXIS * BRICKS_PER_AXIS;
+
+  explicit BrickMap(const ChunkVoxels &voxels);
+  ~BrickMap();
+
+  BrickMap(const BrickMap &) = delete;
+  BrickMap &operator=(const BrickMap &) = delete;
+
+  // Dense copy with the same voxel IDs.
+  ChunkVoxels toVoxels() const;
+
+  uint8_t get(int x, int y, int z) const;
+
+  bool isUniform() const { return headers == nullptr; }
+  uint8_t getUniformID() const { return palette[0]; }
+  int getMixedBrickCount() const { return mixedCount; }
+
+  // Heap bytes owned by this map (headers + mixed bricks + palette).
+  size_t getMemoryUsage() const;
+
+  // Heap bytes owned by every live BrickMap in the process.
+  static size_t getTotalMemoryUsage() {
+    return totalMemoryUsage.load(std::memory_order_relaxed);
+  }
+
+private:
+  // Header of a mixed brick: MIXED_BRICK | index into the mixed bricks.
+  // A uniform brick's header is its voxel ID.
+  static constexpr uint16_t MIXED_BRICK = 0x8000;
+
+  static inline int toBrick(int x, int y, int z) {
+    return ((x / BRICK_SIZE) * BRICKS_PER_AXIS + y / BRICK_SIZE) *
+               BRICKS_PER_AXIS +
+           z / BRICK_SIZE;
+  }
+  static inline int toBrickVoxel(int x, int y, int z) {
+    return ((x % BRICK_SIZE) * BRICK_SIZE + y % BRICK_SIZE) * BRICK_SIZE +
+           z % BRICK_SIZE;
+  }
+
+  uint8_t getMixed(int mixedIndex, int brickVoxel) const;
+
+  // Distinct IDs in the chunk; for a uniform map, palette[0] is its ID.
+  std::vector<uint8_t> palette;
+  // BRICK_COUNT headers; null when the whole chunk is one ID.
+  std::unique_ptr<uint16_t[]> headers;
+  // Mixed bricks, bitsPerVoxel words each (64 voxels per brick).
+  std::unique_ptr<uint64_t[]> words;
+  uint16_t mixedCount = 0;
+  uint8_t bitsPerVoxel = 0;
+
+  static std::atomic<size_t> totalMemoryUsage;
+};
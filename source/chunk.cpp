@@ -1,197 +1,873 @@
 #include "chunk.hpp"
+#include "meshCache.hpp"
+#include "meshKernels.hpp"
+#include "surfaceNets.hpp"
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 
-Chunk::Chunk(glm::ivec3 position)
-    : meshNeedsUpdate(true), chunkPosition(position),
-      status(ChunkState::UNINITIALIZED),
-      VAO(0), VBO(0), glResourcesInitialized(false) {
+const glm::ivec3 DIAGONAL_OFFSETS[DIAGONAL_NEIGHBOR_COUNT] = {
+    // Edges along z, y and x.
+    {1, 1, 0}, {1, -1, 0}, {-1, 1, 0}, {-1, -1, 0},
+    {1, 0, 1}, {1, 0, -1}, {-1, 0, 1}, {-1, 0, -1},
+    {0, 1, 1}, {0, 1, -1}, {0, -1, 1}, {0, -1, -1},
+    // Corners.
+    {1, 1, 1}, {1, 1, -1}, {1, -1, 1}, {1, -1, -1},
+    {-1, 1, 1}, {-1, 1, -1}, {-1, -1, 1}, {-1, -1, -1}};
+
+// Face drawn by faces along axis d whose normal points towards direction.
+static constexpr Voxel::VoxelFace getAxisFace(int d, int direction) {
+  return (d == 0)   ? (direction > 0 ? Voxel::RIGHT : Voxel::LEFT)
+         : (d == 1) ? (direction > 0 ? Voxel::TOP : Voxel::BOTTOM)
+                    : (direction > 0 ? Voxel::FRONT : Voxel::BACK);
+}
+
+static int64_t steadyNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Shared by every chunk that hasn't been meshed yet.
+static const ChunkMeshPtr &getEmptyMesh() {
+  static const ChunkMeshPtr emptyMesh = std::make_shared<ChunkMesh>();
+  return emptyMesh;
+}
 
+Chunk::Chunk(glm::ivec3 position, uint32_t registrySlot,
+             ChunkStateFlags &state)
+    : voxelBuffer(std::make_shared<VoxelBuffer>()), mesh(getEmptyMesh()),
+      meshNeedsUpdate(true),
+      chunkPosition(position), registrySlot(registrySlot), state(state) {}
+
+// BoundaryFill of each side of voxels, packed as in Chunk::boundaryFills.
+static uint16_t computeBoundaryFills(const ChunkVoxels &voxels) {
+  constexpr ChunkColumn FULL_COLUMN = (ChunkColumn)~ChunkColumn(0);
+  constexpr ChunkColumn FIRST_BIT = 1;
+  constexpr ChunkColumn LAST_BIT = (ChunkColumn)(ChunkColumn(1)
+                                                 << (CHUNK_DEPTH - 1));
+  if (voxels.isUniform()) {
+    BoundaryFill fill = voxels.getUniformID() == Voxel::EMPTY
+                            ? BoundaryFill::EMPTY
+                            : BoundaryFill::FULL;
+    uint16_t packed = 0;
+    for (int dir = 0; dir < 6; ++dir)
+      packed |= (uint16_t)((int)fill << (2 * dir));
+    return packed;
+  }
+
+  // Per side: whether any boundary voxel is solid, and whether all are.
+  bool any[6] = {}, all[6] = {true, true, true, true, true, true};
+  auto add = [&](int dir, bool solidAny, bool solidAll) {
+    any[dir] |= solidAny;
+    all[dir] &= solidAll;
+  };
   for (int x = 0; x < CHUNK_WIDTH; ++x) {
     for (int y = 0; y < CHUNK_HEIGHT; ++y) {
-      for (int z = 0; z < CHUNK_DEPTH; ++z) {
-        voxelIDs[x][y][z] = Voxel::EMPTY;
-      }
+      ChunkColumn column = voxels.getColumn(x, y);
+      add(NEIGHBOR_NEG_Z, column & FIRST_BIT, column & FIRST_BIT);
+      add(NEIGHBOR_POS_Z, column & LAST_BIT, column & LAST_BIT);
+      if (x == 0)
+        add(NEIGHBOR_NEG_X, column != 0, column == FULL_COLUMN);
+      if (x == CHUNK_WIDTH - 1)
+        add(NEIGHBOR_POS_X, column != 0, column == FULL_COLUMN);
+      if (y == 0)
+        add(NEIGHBOR_NEG_Y, column != 0, column == FULL_COLUMN);
+      if (y == CHUNK_HEIGHT - 1)
+        add(NEIGHBOR_POS_Y, column != 0, column == FULL_COLUMN);
     }
   }
-}
 
-Chunk::~Chunk() {
-  if (glResourcesInitialized) {
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+  uint16_t packed = 0;
+  for (int dir = 0; dir < 6; ++dir) {
+    BoundaryFill fill = all[dir]   ? BoundaryFill::FULL
+                        : any[dir] ? BoundaryFill::MIXED
+                                   : BoundaryFill::EMPTY;
+    packed |= (uint16_t)((int)fill << (2 * dir));
   }
+  return packed;
+}
+
+void Chunk::publishLocked(ChunkVoxels &&voxels, uint64_t version) {
+  boundaryFills.store(computeBoundaryFills(voxels), std::memory_order_release);
+  auto buffer = std::make_shared<VoxelBuffer>();
+  buffer->voxels = std::move(voxels);
+  buffer->version = version;
+  std::atomic_store(&voxelBuffer, VoxelBufferPtr(std::move(buffer)));
+  compact = false;
+  meshNeedsUpdate = true;
 }
 
 void Chunk::setVoxel(int x, int y, int z, uint8_t voxelID) {
-  if (x >= 0 && x < CHUNK_WIDTH && y >= 0 && y < CHUNK_HEIGHT && z >= 0 &&
-      z < CHUNK_DEPTH) {
-    voxelIDs[x][y][z] = voxelID;
-    meshNeedsUpdate = true;
+  if (x < 0 || x >= CHUNK_WIDTH || y < 0 || y >= CHUNK_HEIGHT || z < 0 ||
+      z >= CHUNK_DEPTH)
+    return;
+
+  int index = ChunkVoxels::toIndex(x, y, z);
+  const int pos[3] = {x, y, z};
+  {
+    std::lock_guard<std::mutex> lock(editMutex);
+    VoxelBufferPtr current = std::atomic_load(&voxelBuffer);
+    // Rewriting the value a voxel already holds (e.g. a uniform chunk's own
+    // ID) keeps the current version, so the chunk stays uniform and keeps
+    // its mesh.
+    if (current->get(x, y, z) == voxelID)
+      return;
+
+    // Editing a far-field chunk brings it back to dense storage.
+    ChunkVoxels edited =
+        current->bricks ? current->bricks->toVoxels() : current->voxels;
+    edited.set(index, voxelID);
+
+    // Along each axis the voxel's own layer changes, plus the layer behind
+    // it: a +D face at layer c - 1 (or -D face at c + 1) depends on whether
+    // this voxel is solid. Flagged before publishing, so a mesh job that
+    // sees the new version also sees its slices.
+    for (int d = 0; d < 3; ++d) {
+      ChunkColumn layer = (ChunkColumn)(ChunkColumn(1) << pos[d]);
+      markSlicesDirty(getAxisFace(d, +1), layer | (ChunkColumn)(layer >> 1));
+      markSlicesDirty(getAxisFace(d, -1), layer | (ChunkColumn)(layer << 1));
+    }
+    int64_t noEdit = 0;
+    pendingEditTime.compare_exchange_strong(noEdit, steadyNow());
+
+    publishLocked(std::move(edited), current->version + 1);
+    state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
+  }
+
+  // Border voxels are also part of the adjacent chunk's mesh input, where
+  // they affect its faces on the shared boundary layer and the occlusion of
+  // the faces around them.
+  int borderDirs[3] = {
+      x == 0 ? NEIGHBOR_NEG_X : x == CHUNK_WIDTH - 1 ? NEIGHBOR_POS_X : -1,
+      y == 0 ? NEIGHBOR_NEG_Y : y == CHUNK_HEIGHT - 1 ? NEIGHBOR_POS_Y : -1,
+      z == 0 ? NEIGHBOR_NEG_Z : z == CHUNK_DEPTH - 1 ? NEIGHBOR_POS_Z : -1};
+  ChunkColumn sideLayers[3];
+  for (int e = 0; e < 3; ++e) {
+    ChunkColumn layer = (ChunkColumn)(ChunkColumn(1) << pos[e]);
+    sideLayers[e] = (ChunkColumn)(layer | (layer >> 1) | (layer << 1));
+  }
+  for (int d = 0; d < 3; ++d) {
+    int dir = borderDirs[d];
+    Chunk *neighborChunk = (dir >= 0) ? getNeighbor(dir) : nullptr;
+    if (neighborChunk != nullptr) {
+      // The neighbor sees this chunk in the opposite direction, dir ^ 1.
+      int64_t noEdit = 0;
+      neighborChunk->pendingEditTime.compare_exchange_strong(noEdit,
+                                                             steadyNow());
+      neighborChunk->markBoundarySlicesDirty(dir ^ 1, sideLayers);
+    }
+  }
+
+  // A voxel on an edge or corner of the chunk also shades the faces of the
+  // chunks touching it there.
+  if (Voxel::VERTEX_AO_BITS == 0)
+    return;
+  for (const glm::ivec3 &offset : DIAGONAL_OFFSETS) {
+    bool touches = true;
+    for (int d = 0; d < 3; ++d)
+      if (offset[d] != 0 &&
+          borderDirs[d] != getNeighborDirection(d, offset[d]))
+        touches = false;
+    Chunk *diagonal = touches ? getDiagonalNeighbor(offset) : nullptr;
+    if (diagonal != nullptr) {
+      int64_t noEdit = 0;
+      diagonal->pendingEditTime.compare_exchange_strong(noEdit, steadyNow());
+      diagonal->markDiagonalSlicesDirty(-offset, sideLayers);
+    }
   }
 }
 
-bool Chunk::shouldRenderFace(int x, int y, int z, int d, int direction) const {
-  int nx = x + (d == 0 ? direction : 0);
-  int ny = y + (d == 1 ? direction : 0);
-  int nz = z + (d == 2 ? direction : 0);
+void Chunk::markBoundarySlicesDirty(int direction,
+                                    const ChunkColumn sideLayers[3]) {
+  int d = direction / 2;
+  bool positive = (direction == getNeighborDirection(d, +1));
+  markSlicesDirty(
+      getAxisFace(d, positive ? +1 : -1),
+      (ChunkColumn)(ChunkColumn(1) << (positive ? CHUNK_DEPTH - 1 : 0)));
+  if (Voxel::VERTEX_AO_BITS != 0) {
+    for (int e = 0; e < 3; ++e) {
+      if (e == d)
+        continue;
+      markSlicesDirty(getAxisFace(e, +1), sideLayers[e]);
+      markSlicesDirty(getAxisFace(e, -1), sideLayers[e]);
+    }
+  }
+  meshNeedsUpdate = true;
+  state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
+}
 
-  if (nx >= 0 && nx < CHUNK_WIDTH && ny >= 0 && ny < CHUNK_HEIGHT &&
-      nz >= 0 && nz < CHUNK_DEPTH) {
-    return voxelIDs[nx][ny][nz] == Voxel::EMPTY;
+void Chunk::markDiagonalSlicesDirty(const glm::ivec3 &offset,
+                                    const ChunkColumn sideLayers[3]) {
+  for (int e = 0; e < 3; ++e) {
+    ChunkColumn layers =
+        (offset[e] > 0)   ? (ChunkColumn)(ChunkColumn(1) << (CHUNK_DEPTH - 1))
+        : (offset[e] < 0) ? ChunkColumn(1)
+                          : sideLayers[e];
+    markSlicesDirty(getAxisFace(e, +1), layers);
+    markSlicesDirty(getAxisFace(e, -1), layers);
   }
+  meshNeedsUpdate = true;
+  state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
+}
 
-  int neighborDir = getNeighborDirection(d, direction);
-  Chunk *neighborChunk = neighbors[neighborDir].load(std::memory_order_acquire);
-  if (neighborChunk == nullptr)
-    return true;
+void Chunk::diagonalBoundaryChanged(const glm::ivec3 &offset) {
+  if (Voxel::VERTEX_AO_BITS == 0)
+    return;
+  const ChunkColumn all = (ChunkColumn)~ChunkColumn(0);
+  const ChunkColumn sideLayers[3] = {all, all, all};
+  markDiagonalSlicesDirty(offset, sideLayers);
+}
 
-  int bx = (nx < 0) ? CHUNK_WIDTH - 1  : (nx >= CHUNK_WIDTH)  ? 0 : nx;
-  int by = (ny < 0) ? CHUNK_HEIGHT - 1 : (ny >= CHUNK_HEIGHT) ? 0 : ny;
-  int bz = (nz < 0) ? CHUNK_DEPTH - 1  : (nz >= CHUNK_DEPTH)  ? 0 : nz;
+bool Chunk::hasSolidEdge(const glm::ivec3 &offset) const {
+  VoxelBufferPtr buffer = getVoxelSnapshot();
+  int pos[3];
+  int axis = -1;
+  for (int d = 0; d < 3; ++d) {
+    pos[d] = (offset[d] > 0) ? CHUNK_SIZE - 1 : 0;
+    if (offset[d] == 0)
+      axis = d;
+  }
+  const int count = (axis < 0) ? 1 : CHUNK_SIZE;
+  for (int t = 0; t < count; ++t) {
+    if (axis >= 0)
+      pos[axis] = t;
+    if (buffer->get(pos[0], pos[1], pos[2]) != Voxel::EMPTY)
+      return true;
+  }
+  return false;
+}
 
-  return neighborChunk->voxelIDs[bx][by][bz] == Voxel::EMPTY;
+bool Chunk::neighborBoundaryChanged(int direction, BoundaryFill neighborFill) {
+  if (neighborFill == BoundaryFill::EMPTY)
+    return false;
+  // A coarsened chunk can have solid blocks on a boundary layer that is
+  // empty at full resolution, so only level 0 trusts its own summary.
+  BoundaryFill ownFill = getBoundaryFill(direction);
+  if (getLodLevel() == 0 && ownFill == BoundaryFill::EMPTY)
+    return false;
+
+  // The neighbor's layer also shades the other four faces along the
+  // boundary, on every layer. A full boundary layer only has such faces
+  // on the chunk's rim.
+  constexpr ChunkColumn RIM_LAYERS =
+      (ChunkColumn)(ChunkColumn(1) | (ChunkColumn(1) << (CHUNK_DEPTH - 1)));
+  ChunkColumn layers = (ownFill == BoundaryFill::FULL && getLodLevel() == 0)
+                           ? RIM_LAYERS
+                           : (ChunkColumn)~ChunkColumn(0);
+  const ChunkColumn sideLayers[3] = {layers, layers, layers};
+  markBoundarySlicesDirty(direction, sideLayers);
+  return true;
 }
 
-void Chunk::greedyMeshAxis(std::vector<Voxel::PackedVoxel> &meshData, int d,
-                           int u, int v, int direction,
-                           Voxel::VoxelFace faceDir) {
-  int dims[3] = {CHUNK_WIDTH, CHUNK_HEIGHT, CHUNK_DEPTH};
-  std::vector<uint8_t> mask(dims[u] * dims[v], 0);
+void Chunk::fill(uint8_t voxelID) {
+  std::lock_guard<std::mutex> lock(editMutex);
+  fullRemeshNeeded = true;
+  publishLocked(ChunkVoxels(voxelID), getVoxelVersion() + 1);
+}
 
-  for (int depthLayer = 0; depthLayer < dims[d]; ++depthLayer) {
-    std::fill(mask.begin(), mask.end(), 0);
+void Chunk::compactVoxels() {
+  std::lock_guard<std::mutex> lock(editMutex);
+  VoxelBufferPtr current = std::atomic_load(&voxelBuffer);
+  if (current->isCompact() || current->voxels.isUniform())
+    return;
 
-    for (int uu = 0; uu < dims[u]; ++uu) {
-      for (int vv = 0; vv < dims[v]; ++vv) {
-        int x = (d == 0) ? depthLayer : (u == 0) ? uu : vv;
-        int y = (d == 1) ? depthLayer : (u == 1) ? uu : vv;
-        int z = (d == 2) ? depthLayer : (u == 2) ? uu : vv;
+  auto buffer = std::make_shared<VoxelBuffer>();
+  buffer->bricks.reset(new BrickMap(current->voxels));
+  buffer->version = current->version;
+  std::atomic_store(&voxelBuffer, VoxelBufferPtr(std::move(buffer)));
+  compact = true;
+}
 
-        uint8_t voxelID = voxelIDs[x][y][z];
+void Chunk::expandVoxels() {
+  std::lock_guard<std::mutex> lock(editMutex);
+  VoxelBufferPtr current = std::atomic_load(&voxelBuffer);
+  if (!current->isCompact())
+    return;
 
-        if (voxelID != Voxel::EMPTY &&
-            shouldRenderFace(x, y, z, d, direction)) {
-          mask[uu + vv * dims[u]] = voxelID;
-        } else {
-          mask[uu + vv * dims[u]] = 0;
-        }
-      }
-    }
+  auto buffer = std::make_shared<VoxelBuffer>();
+  buffer->voxels = current->bricks->toVoxels();
+  buffer->version = current->version;
+  std::atomic_store(&voxelBuffer, VoxelBufferPtr(std::move(buffer)));
+  compact = false;
+}
 
-    for (int uu = 0; uu < dims[u]; ++uu) {
-      for (int vv = 0; vv < dims[v];) {
-        uint8_t voxelID = mask[uu + vv * dims[u]];
+void Chunk::publishVoxels(ChunkVoxels &&voxels) {
+  std::lock_guard<std::mutex> lock(editMutex);
+  fullRemeshNeeded = true;
+  publishLocked(std::move(voxels), getVoxelVersion() + 1);
+}
 
-        if (voxelID == 0) {
-          ++vv;
+uint8_t Chunk::getVoxel_ID(int x, int y, int z) const {
+  if (x >= 0 && x < CHUNK_WIDTH && y >= 0 && y < CHUNK_HEIGHT && z >= 0 &&
+      z < CHUNK_DEPTH) {
+    return getVoxelSnapshot()->get(x, y, z);
+  }
+  return Voxel::EMPTY;
+}
+
+void Chunk::gatherMeshSources(ChunkMeshSources &sources) const {
+  sources.self = getVoxelSnapshot();
+  sources.lodLevel = getLodLevel();
+  sources.smoothDensity = nullptr;
+  for (int dir = 0; dir < 6; ++dir) {
+    const Chunk *neighborChunk = getNeighbor(dir);
+    sources.neighbors[dir] =
+        neighborChunk ? neighborChunk->getVoxelSnapshot() : nullptr;
+  }
+  for (int i = 0; i < DIAGONAL_NEIGHBOR_COUNT; ++i) {
+    const Chunk *diagonal = getDiagonalNeighbor(DIAGONAL_OFFSETS[i]);
+    sources.diagonals[i] = diagonal ? diagonal->getVoxelSnapshot() : nullptr;
+  }
+}
+
+// Coarsens the chunk's own voxels in input to blocks of 2^lodLevel voxels
+// per side, in place. A block is solid if any voxel in it is, and takes the
+// ID of its topmost solid voxel, the one most likely to be seen.
+//
+// Because of the "any" rule a coarse surface always encloses the full
+// resolution one. Neighbors cull their border faces against this chunk's
+// full-resolution voxels, and every such solid voxel lies inside a solid
+// block here, so chunks at different levels meet without cracks.
+static void downsampleMeshInput(ChunkMeshInput &input, int lodLevel) {
+  const int s = 1 << lodLevel;
+  // Bits 1 .. s of a padded column: one block along z.
+  const PaddedColumn blockBits = (PaddedColumn)(((1u << s) - 1) << 1);
+
+  for (int bx = 0; bx < CHUNK_WIDTH; bx += s) {
+    for (int by = 0; by < CHUNK_HEIGHT; by += s) {
+      PaddedColumn any = 0;
+      for (int x = bx; x < bx + s; ++x)
+        for (int y = by; y < by + s; ++y)
+          any |= input.columns[x + 1][y + 1];
+      if (any == 0)
+        continue;
+
+      PaddedColumn coarse = 0;
+      for (int bz = 0; bz < CHUNK_DEPTH; bz += s) {
+        PaddedColumn bits = (PaddedColumn)(blockBits << bz);
+        if ((any & bits) == 0)
           continue;
-        }
+        coarse |= bits;
 
-        int meshWidth = 1;
-        while (vv + meshWidth < dims[v] &&
-               mask[uu + (vv + meshWidth) * dims[u]] == voxelID) {
-          ++meshWidth;
-        }
+        uint8_t voxelID = Voxel::EMPTY;
+        for (int y = by + s - 1; y >= by && voxelID == Voxel::EMPTY; --y)
+          for (int x = bx; x < bx + s && voxelID == Voxel::EMPTY; ++x)
+            for (int z = bz; z < bz + s && voxelID == Voxel::EMPTY; ++z)
+              voxelID = input.voxels[x + 1][y + 1][z + 1];
 
-        int meshHeight = 1;
-        bool canExpand = true;
-        while (uu + meshHeight < dims[u] && canExpand) {
-          for (int k = 0; k < meshWidth; ++k) {
-            if (mask[(uu + meshHeight) + (vv + k) * dims[u]] != voxelID) {
-              canExpand = false;
-              break;
-            }
-          }
-          if (canExpand)
-            ++meshHeight;
-        }
+        for (int x = bx; x < bx + s; ++x)
+          for (int y = by; y < by + s; ++y)
+            std::memset(&input.voxels[x + 1][y + 1][bz + 1], voxelID, s);
+      }
 
-        int x = (d == 0) ? depthLayer : (u == 0) ? uu : vv;
-        int y = (d == 1) ? depthLayer : (u == 1) ? uu : vv;
-        int z = (d == 2) ? depthLayer : (u == 2) ? uu : vv;
+      for (int x = bx; x < bx + s; ++x)
+        for (int y = by; y < by + s; ++y)
+          input.columns[x + 1][y + 1] = coarse;
+    }
+  }
+}
 
-        meshData.push_back(Voxel::packVertexData(
-            x, y, z, meshWidth, meshHeight, voxelID, faceDir));
+void Chunk::captureMeshInput(const ChunkMeshSources &sources,
+                             ChunkMeshInput &input) {
+  constexpr int P = PADDED_CHUNK_SIZE;
+  // Far-field chunks (self or neighbors) are expanded on the fly; they are
+  // only remeshed when a neighbor loads or unloads next to them.
+  ChunkVoxels scratch;
+  const ChunkVoxels &voxels = sources.self->getDense(scratch);
+  std::memset(input.voxels, 0, sizeof(input.voxels));
+  std::memset(input.columns, 0, sizeof(input.columns));
 
-        for (int hh = 0; hh < meshHeight; ++hh) {
-          for (int ww = 0; ww < meshWidth; ++ww) {
-            mask[(uu + hh) + (vv + ww) * dims[u]] = 0;
+  for (int x = 0; x < CHUNK_WIDTH; ++x) {
+    for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+      voxels.decodeColumn(x, y, &input.voxels[x + 1][y + 1][1]);
+      input.columns[x + 1][y + 1] = (PaddedColumn)voxels.getColumn(x, y) << 1;
+    }
+  }
+  input.singleSolidID = voxels.hasSingleSolidID();
+  input.uniform = voxels.isUniform();
+  input.uniformID = input.uniform ? voxels.getUniformID() : (uint8_t)Voxel::EMPTY;
+  input.version = sources.self->version;
+  input.lodLevel = sources.lodLevel;
+  input.smoothDensity = sources.smoothDensity;
+  // A uniform chunk looks the same at every level.
+  if (input.lodLevel > 0 && !input.uniform)
+    downsampleMeshInput(input, input.lodLevel);
+
+  for (int dir = 0; dir < 6; ++dir) {
+    input.borderSolidCount[dir] = 0;
+    if (sources.neighbors[dir] == nullptr)
+      continue;
+
+    const ChunkVoxels &n = sources.neighbors[dir]->getDense(scratch);
+    int solid = 0;
+    switch (dir) {
+    case NEIGHBOR_POS_X:
+    case NEIGHBOR_NEG_X: {
+      int srcX = (dir == NEIGHBOR_POS_X) ? 0 : CHUNK_WIDTH - 1;
+      int dstX = (dir == NEIGHBOR_POS_X) ? P - 1 : 0;
+      for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+        ChunkColumn column = n.getColumn(srcX, y);
+        n.decodeColumn(srcX, y, &input.voxels[dstX][y + 1][1]);
+        input.columns[dstX][y + 1] = (PaddedColumn)column << 1;
+        solid += __builtin_popcount(column);
+      }
+      break;
+    }
+    case NEIGHBOR_POS_Y:
+    case NEIGHBOR_NEG_Y: {
+      int srcY = (dir == NEIGHBOR_POS_Y) ? 0 : CHUNK_HEIGHT - 1;
+      int dstY = (dir == NEIGHBOR_POS_Y) ? P - 1 : 0;
+      for (int x = 0; x < CHUNK_WIDTH; ++x) {
+        ChunkColumn column = n.getColumn(x, srcY);
+        n.decodeColumn(x, srcY, &input.voxels[x + 1][dstY][1]);
+        input.columns[x + 1][dstY] = (PaddedColumn)column << 1;
+        solid += __builtin_popcount(column);
+      }
+      break;
+    }
+    default: {
+      int srcZ = (dir == NEIGHBOR_POS_Z) ? 0 : CHUNK_DEPTH - 1;
+      int dstZ = (dir == NEIGHBOR_POS_Z) ? P - 1 : 0;
+      for (int x = 0; x < CHUNK_WIDTH; ++x) {
+        for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+          uint8_t voxelID = n.get(ChunkVoxels::toIndex(x, y, srcZ));
+          input.voxels[x + 1][y + 1][dstZ] = voxelID;
+          if (voxelID != Voxel::EMPTY) {
+            input.columns[x + 1][y + 1] |= PaddedColumn(1) << dstZ;
+            ++solid;
           }
         }
+      }
+      break;
+    }
+    }
 
-        vv += meshWidth;
+    input.borderSolidCount[dir] = solid;
+  }
+
+  // Edge rows and corners, one cell past two or three faces at once.
+  for (int i = 0; i < DIAGONAL_NEIGHBOR_COUNT; ++i) {
+    if (sources.diagonals[i] == nullptr)
+      continue;
+    const ChunkVoxels &n = sources.diagonals[i]->getDense(scratch);
+    const glm::ivec3 &offset = DIAGONAL_OFFSETS[i];
+    int src[3], dst[3];
+    int axis = -1;
+    for (int d = 0; d < 3; ++d) {
+      src[d] = (offset[d] > 0) ? 0 : CHUNK_SIZE - 1;
+      dst[d] = (offset[d] > 0) ? P - 1 : 0;
+      if (offset[d] == 0)
+        axis = d;
+    }
+    const int count = (axis < 0) ? 1 : CHUNK_SIZE;
+    for (int t = 0; t < count; ++t) {
+      if (axis >= 0) {
+        src[axis] = t;
+        dst[axis] = t + 1;
       }
+      uint8_t voxelID = n.get(ChunkVoxels::toIndex(src[0], src[1], src[2]));
+      input.voxels[dst[0]][dst[1]][dst[2]] = voxelID;
+      if (voxelID != Voxel::EMPTY)
+        input.columns[dst[0]][dst[1]] |= PaddedColumn(1) << dst[2];
     }
   }
 }
 
-void Chunk::generateMesh() {
-  if (markedForDeletion)
-    return;
-  if (!meshNeedsUpdate)
-    return;
-  status = ChunkState::GENERATING;
+// Slice layout for faces along axis D: one slice per layer along D, rows
+// along U and bits along V, the same (u, v) pairing the quads are packed in.
+template <int D, int DIRECTION> struct MeshAxis {
+  static constexpr int U = (D == 0) ? 1 : 0;
+  static constexpr int V = (D == 2) ? 1 : 2;
+  static constexpr Voxel::VoxelFace FACE = getAxisFace(D, DIRECTION);
+
+  // Padded input voxel at slice position (layer, uu, vv).
+  static uint8_t voxelAt(const ChunkMeshInput &input, int layer, int uu,
+                         int vv) {
+    int pos[3];
+    pos[D] = layer;
+    pos[U] = uu;
+    pos[V] = vv;
+    return input.voxels[pos[0] + 1][pos[1] + 1][pos[2] + 1];
+  }
 
-  std::vector<Voxel::PackedVoxel> newMeshData;
+  // Baked occlusion of the face at (layer, uu, vv), in the vertex layout
+  // (see Voxel::packVertexData). Each corner is darkened by the solid
+  // voxels among the three that touch it in the layer the face looks into.
+  static uint8_t occlusionAt(const ChunkMeshInput &input, int layer, int uu,
+                             int vv) {
+    int front = layer + DIRECTION;
+    bool solid[3][3];
+    for (int du = -1; du <= 1; ++du)
+      for (int dv = -1; dv <= 1; ++dv)
+        solid[du + 1][dv + 1] =
+            voxelAt(input, front, uu + du, vv + dv) != Voxel::EMPTY;
+
+    uint8_t occlusion = 0;
+    for (int uEnd = 0; uEnd < 2; ++uEnd) {
+      for (int vEnd = 0; vEnd < 2; ++vEnd) {
+        bool sideU = solid[uEnd * 2][1];
+        bool sideV = solid[1][vEnd * 2];
+        bool corner = solid[uEnd * 2][vEnd * 2];
+        int open = (sideU && sideV) ? 0 : 3 - sideU - sideV - corner;
+        occlusion |= (uint8_t)(open << (2 * (uEnd * 2 + vEnd)));
+      }
+    }
+    return occlusion;
+  }
 
-  greedyMeshAxis(newMeshData, 0, 1, 2, -1, Voxel::LEFT);
-  greedyMeshAxis(newMeshData, 0, 1, 2, +1, Voxel::RIGHT);
-  greedyMeshAxis(newMeshData, 1, 0, 2, -1, Voxel::BOTTOM);
-  greedyMeshAxis(newMeshData, 1, 0, 2, +1, Voxel::TOP);
-  greedyMeshAxis(newMeshData, 2, 0, 1, -1, Voxel::BACK);
-  greedyMeshAxis(newMeshData, 2, 0, 1, +1, Voxel::FRONT);
+  static Voxel::PackedVoxel pack(int layer, int uu, int vv, int width,
+                                 int height, uint8_t voxelID,
+                                 uint8_t occlusion) {
+    int pos[3];
+    pos[D] = layer;
+    pos[U] = uu;
+    pos[V] = vv;
+    return Voxel::packVertexData(pos[0], pos[1], pos[2], width, height,
+                                 voxelID, occlusion);
+  }
+};
+
+// Binary greedy mesher, one slice at a time. A slice is a stack of bit rows
+// (one per u, bits along v); quads start at the lowest set bit, grow along v
+// over the run of set bits and then along u while the next row covers the
+// whole run. The visiting order matches the old per-voxel mask scan, and
+// runs also stop at faces whose baked occlusion differs. The axis is a
+// template parameter, so the position shuffles in MeshAxis fold into fixed
+// offsets.
+template <int D, int DIRECTION>
+void Chunk::greedyMeshSlice(std::vector<Voxel::PackedVoxel> &meshData,
+                            const ChunkMeshInput &input,
+                            ChunkColumn rows[CHUNK_DEPTH], int depthLayer) {
+  static_assert(CHUNK_WIDTH == CHUNK_DEPTH && CHUNK_HEIGHT == CHUNK_DEPTH,
+                "binary mesher assumes cubic chunks");
+  typedef MeshAxis<D, DIRECTION> Axis;
+  constexpr bool bakeOcclusion = Voxel::VERTEX_AO_BITS != 0;
+
+  // Occlusion of every face in the slice; quads only merge over faces whose
+  // four corners match.
+  uint8_t occlusion[CHUNK_DEPTH][CHUNK_DEPTH];
+  if (bakeOcclusion) {
+    for (int uu = 0; uu < CHUNK_DEPTH; ++uu) {
+      for (ChunkColumn bits = rows[uu]; bits != 0; bits &= bits - 1) {
+        int vv = __builtin_ctz(bits);
+        occlusion[uu][vv] = Axis::occlusionAt(input, depthLayer, uu, vv);
+      }
+    }
+  }
 
-  meshData = std::move(newMeshData);
-  meshNeedsUpdate = false;
-  status = ChunkState::WAITING_FOR_UPLOAD;
+  // With a single solid ID and no occlusion every visible face can merge
+  // with any other, so runs come straight from the bits. Otherwise each
+  // cell must also match.
+  bool checkCells = !input.singleSolidID || bakeOcclusion;
+
+  for (int uu = 0; uu < CHUNK_DEPTH; ++uu) {
+    while (rows[uu] != 0) {
+      int vv = __builtin_ctz(rows[uu]);
+      uint8_t voxelID = Axis::voxelAt(input, depthLayer, uu, vv);
+      uint8_t cellOcclusion =
+          bakeOcclusion ? occlusion[uu][vv] : (uint8_t)Voxel::VERTEX_AO_OPEN;
+      auto matches = [&](int u, int v) {
+        return Axis::voxelAt(input, depthLayer, u, v) == voxelID &&
+               (!bakeOcclusion || occlusion[u][v] == cellOcclusion);
+      };
+
+      int meshWidth = __builtin_ctzll(~((uint64_t)rows[uu] >> vv));
+      if (checkCells) {
+        int k = 1;
+        while (k < meshWidth && matches(uu, vv + k))
+          ++k;
+        meshWidth = k;
+      }
+      ChunkColumn runMask = (ChunkColumn)(((1ull << meshWidth) - 1) << vv);
+
+      int meshHeight = 1;
+      while (uu + meshHeight < CHUNK_DEPTH &&
+             (rows[uu + meshHeight] & runMask) == runMask) {
+        if (checkCells) {
+          bool rowMatches = true;
+          for (int k = 0; k < meshWidth && rowMatches; ++k)
+            rowMatches = matches(uu + meshHeight, vv + k);
+          if (!rowMatches)
+            break;
+        }
+        ++meshHeight;
+      }
+
+      for (int hh = 0; hh < meshHeight; ++hh)
+        rows[uu + hh] &= ~runMask;
+
+      meshData.push_back(Axis::pack(depthLayer, uu, vv, meshWidth, meshHeight,
+                                    voxelID, cellOcclusion));
+    }
+  }
 }
 
-void Chunk::initGLResources() {
-  if (glResourcesInitialized)
+template <int D, int DIRECTION>
+void Chunk::meshFace(ChunkMesh &newMesh, const ChunkMeshInput &input,
+                     ChunkColumn layers) const {
+  typedef MeshAxis<D, DIRECTION> Axis;
+  constexpr ChunkColumn ALL_LAYERS = (ChunkColumn)~ChunkColumn(0);
+  std::vector<Voxel::PackedVoxel> &newMeshData = newMesh.quads;
+  const std::vector<Voxel::PackedVoxel> &meshData = mesh->quads;
+  const uint32_t *oldOffsets = mesh->sliceOffsets + Axis::FACE * CHUNK_DEPTH;
+  // offsets[0] is where the previous face ended.
+  uint32_t *offsets = newMesh.sliceOffsets + Axis::FACE * CHUNK_DEPTH;
+
+  if (layers == 0) {
+    // Untouched face: copied whole and shifted to where it now starts.
+    uint32_t shift = offsets[0] - oldOffsets[0];
+    newMeshData.insert(newMeshData.end(), meshData.begin() + oldOffsets[0],
+                       meshData.begin() + oldOffsets[CHUNK_DEPTH]);
+    for (int layer = 1; layer <= CHUNK_DEPTH; ++layer)
+      offsets[layer] = oldOffsets[layer] + shift;
     return;
+  }
 
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
+  // Faces of a uniform chunk can only appear on its boundary layer, so the
+  // whole face resolves to nothing, one full-face quad, or a boundary-only
+  // pass.
+  if (layers == ALL_LAYERS && input.uniform) {
+    int borderSolid =
+        input.borderSolidCount[getNeighborDirection(D, DIRECTION)];
+    if (input.uniformID == Voxel::EMPTY ||
+        borderSolid == CHUNK_DEPTH * CHUNK_DEPTH) {
+      std::fill(offsets + 1, offsets + CHUNK_DEPTH + 1, offsets[0]);
+      return;
+    }
+    if (borderSolid == 0) {
+      int layer = (DIRECTION > 0) ? CHUNK_DEPTH - 1 : 0;
+      std::fill(offsets + 1, offsets + layer + 1, offsets[0]);
+      // Nothing in front of the face, so nothing occludes it either.
+      newMeshData.push_back(Axis::pack(layer, 0, 0, CHUNK_DEPTH, CHUNK_DEPTH,
+                                       input.uniformID,
+                                       Voxel::VERTEX_AO_OPEN));
+      std::fill(offsets + layer + 1, offsets + CHUNK_DEPTH + 1,
+                (uint32_t)newMeshData.size());
+      return;
+    }
+  }
 
-  glBindVertexArray(VAO);
-  glEnableVertexAttribArray(0);
-  glVertexAttribDivisor(0, 1);
+  // faceMasks[slice][row]: one bit per voxel along v for every face on that
+  // slice that should be drawn.
+  ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH];
+  MeshKernels::getActiveFaceMaskKernel()(input.columns, D, DIRECTION,
+                                         faceMasks);
+
+  for (int layer = 0; layer < CHUNK_DEPTH; ++layer) {
+    if ((layers >> layer) & 1)
+      greedyMeshSlice<D, DIRECTION>(newMeshData, input, faceMasks[layer],
+                                    layer);
+    else
+      newMeshData.insert(newMeshData.end(),
+                         meshData.begin() + oldOffsets[layer],
+                         meshData.begin() + oldOffsets[layer + 1]);
+    offsets[layer + 1] = (uint32_t)newMeshData.size();
+  }
+}
 
-  glResourcesInitialized = true;
+void Chunk::releaseMeshData() {
+  if (keepMeshData.load(std::memory_order_relaxed) || meshDataReleased)
+    return;
+  // A cached mesh stays: the cache only holds it weakly, and it is what
+  // later chunks with the same input hit.
+  if (!mesh->key.isNull())
+    return;
+  mesh = getEmptyMesh();
+  meshDataReleased = true;
 }
 
-bool Chunk::updateVBO() {
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void *)0);
-  if (meshData.empty()) {
-    glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
-  } else {
-    glBufferData(GL_ARRAY_BUFFER, meshData.size() * sizeof(Voxel::PackedVoxel),
-                 meshData.data(), GL_DYNAMIC_DRAW);
-  }
+bool Chunk::hasPendingMeshWork() const {
+  if (meshNeedsUpdate || fullRemeshNeeded)
+    return true;
+  for (int face = 0; face < 6; ++face)
+    if (dirtySlices[face].load() != 0)
+      return true;
+  return false;
+}
 
-  return true;
+void Chunk::skipMeshJob() {
+  std::lock_guard<std::mutex> meshLock(meshMutex);
+  skipMeshJobLocked();
 }
 
-void Chunk::bindAndDraw() {
-  if (markedForDeletion)
+void Chunk::skipMeshJobLocked() {
+  ChunkState expected = ChunkState::GENERATING;
+  state.status.compare_exchange_strong(
+      expected, meshUploadPending ? ChunkState::WAITING_FOR_UPLOAD
+                                  : ChunkState::IDLE);
+}
+
+void Chunk::generateMesh(ChunkMeshInput &input, MeshCache *cache,
+                         TerrainDensityFunction smoothDensity) {
+  if (state.markedForDeletion)
     return;
-  if (status != ChunkState::WAITING_FOR_UPLOAD && status != ChunkState::IDLE)
+  std::lock_guard<std::mutex> meshLock(meshMutex);
+  if (!meshNeedsUpdate) {
+    skipMeshJobLocked();
     return;
-  ChunkState prevStatus = status;
-  status = ChunkState::UPLOADING;
-  initGLResources();
+  }
+  state.status = ChunkState::GENERATING;
+
+  // Take the pending work before capturing the input. An edit here or in a
+  // neighbor's border, or a neighbor linked or unlinked, either lands before
+  // the capture and is in input, or flags work again after this and is
+  // found by the checks at the end.
+  meshNeedsUpdate = false;
+  bool full = fullRemeshNeeded.exchange(false);
+  ChunkColumn dirty[6];
+  bool anyDirty = false;
+  for (int face = 0; face < 6; ++face) {
+    dirty[face] = dirtySlices[face].exchange(0);
+    anyDirty |= dirty[face] != 0;
+  }
+  int64_t editTime = pendingEditTime.exchange(0);
+
+  ChunkMeshSources sources;
+  gatherMeshSources(sources);
+  if (smoothDensity != nullptr) {
+    sources.smoothDensity = smoothDensity;
+    sources.lodLevel = 0;
+  }
+  captureMeshInput(sources, input);
+
+  // Nothing flagged but still asked to mesh: don't trust the current mesh.
+  if (!anyDirty)
+    full = true;
+  // Slices only line up with the current mesh at full resolution and at
+  // the same level.
+  if (input.lodLevel != 0 || input.lodLevel != meshLodLevel)
+    full = true;
+  // Nor once the upload has dropped the current mesh's quads.
+  if (meshDataReleased)
+    full = true;
+  // Smooth meshes have no slices, and any voxel can move their vertices.
+  const bool smooth = input.smoothDensity != nullptr;
+  if (smooth || meshSmooth)
+    full = true;
+  if (full)
+    std::fill(dirty, dirty + 6, (ChunkColumn)~ChunkColumn(0));
+
+  // A full remesh of a non-uniform chunk first looks for an identical
+  // input in the cache. Uniform chunks mesh in a few steps anyway, and
+  // aren't worth hashing. Smooth meshes also depend on the density around
+  // the chunk, which the key doesn't cover.
+  MeshKey key;
+  ChunkMeshPtr newMesh;
+  if (full && cache != nullptr && !input.uniform && !smooth) {
+    key = MeshCache::computeKey(input);
+    newMesh = cache->find(key);
+  }
 
-  glBindVertexArray(VAO);
+  if (!newMesh) {
+    // Built in this worker's scratch mesh, whose buffers have long since
+    // grown to fit any chunk, then copied out at its exact size.
+    static thread_local ChunkMesh scratch;
+    std::fill(std::begin(scratch.sliceOffsets), std::end(scratch.sliceOffsets),
+              0u);
+    scratch.quads.clear();
+    scratch.smoothVertices.clear();
+    scratch.smoothIndices.clear();
+
+    if (smooth) {
+      SurfaceNets::meshChunk(input, chunkPosition, scratch);
+    } else {
+      // In Voxel::VoxelFace order, so each face's quads form one range.
+      static_assert(Voxel::FRONT == 0 && Voxel::BACK == 1 &&
+                        Voxel::TOP == 2 && Voxel::BOTTOM == 3 &&
+                        Voxel::RIGHT == 4 && Voxel::LEFT == 5,
+                    "faces are meshed in VoxelFace order");
+      meshFace<2, +1>(scratch, input, dirty[Voxel::FRONT]);
+      meshFace<2, -1>(scratch, input, dirty[Voxel::BACK]);
+      meshFace<1, +1>(scratch, input, dirty[Voxel::TOP]);
+      meshFace<1, -1>(scratch, input, dirty[Voxel::BOTTOM]);
+      meshFace<0, +1>(scratch, input, dirty[Voxel::RIGHT]);
+      meshFace<0, -1>(scratch, input, dirty[Voxel::LEFT]);
+    }
 
-  if (prevStatus == ChunkState::WAITING_FOR_UPLOAD) {
-    updateVBO();
+    if (scratch.quads.empty() && scratch.smoothIndices.empty()) {
+      // All empty meshes are the same one.
+      newMesh = getEmptyMesh();
+    } else {
+      auto built = std::make_shared<ChunkMesh>();
+      built->quads.assign(scratch.quads.begin(), scratch.quads.end());
+      std::copy(std::begin(scratch.sliceOffsets),
+                std::end(scratch.sliceOffsets), built->sliceOffsets);
+      built->smoothVertices.assign(scratch.smoothVertices.begin(),
+                                   scratch.smoothVertices.end());
+      built->smoothIndices.assign(scratch.smoothIndices.begin(),
+                                  scratch.smoothIndices.end());
+      if (!key.isNull()) {
+        built->key = key;
+        newMesh = cache->insert(std::move(built));
+      } else {
+        newMesh = std::move(built);
+      }
+    }
   }
 
-  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
-                        static_cast<GLsizei>(meshData.size()));
+  // An edit published after the capture but not yet flagged shows up as a
+  // newer version.
+  if (getVoxelVersion() != input.version) {
+    if (full)
+      fullRemeshNeeded = true;
+    else
+      for (int face = 0; face < 6; ++face)
+        markSlicesDirty(face, dirty[face]);
+    int64_t pending = pendingEditTime.load();
+    while (editTime != 0 && (pending == 0 || editTime < pending) &&
+           !pendingEditTime.compare_exchange_weak(pending, editTime)) {
+    }
+    meshNeedsUpdate = true;
+    state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
+    return;
+  }
 
-  status = ChunkState::IDLE;
-}
\ No newline at end of file
+  // Quads that differ from the current mesh: from the first remeshed slice
+  // on, and past the last one only if the slices after it moved.
+  const uint32_t newSize = (uint32_t)newMesh->quads.size();
+  uint32_t changedBegin = 0, changedEnd = newSize;
+  if (!full) {
+    int first = -1, last = -1;
+    for (int slice = 0; slice < 6 * CHUNK_DEPTH; ++slice) {
+      if ((dirty[slice / CHUNK_DEPTH] >> (slice % CHUNK_DEPTH)) & 1) {
+        if (first < 0)
+          first = slice;
+        last = slice;
+      }
+    }
+    changedBegin = newMesh->sliceOffsets[first];
+    if (newMesh->sliceOffsets[last + 1] == mesh->sliceOffsets[last + 1])
+      changedEnd = newMesh->sliceOffsets[last + 1];
+  }
+  // Merged with whatever an earlier mesh left waiting for upload.
+  if (meshDirtyBegin != meshDirtyEnd) {
+    changedBegin = std::min(changedBegin, meshDirtyBegin);
+    changedEnd = std::min(std::max(changedEnd, meshDirtyEnd), newSize);
+  }
+  meshDirtyBegin = changedBegin;
+  meshDirtyEnd = changedEnd;
+  if (editTime != 0 && (meshEditTime == 0 || editTime < meshEditTime))
+    meshEditTime = editTime;
+
+  mesh = std::move(newMesh);
+  meshDataReleased = false;
+  meshLodLevel = input.lodLevel;
+  meshSmooth = smooth;
+  meshUploadPending = true;
+
+  // An edit published after the version check, a neighbor linked or a new
+  // level of detail set while the job ran needs another pass. So does
+  // anyone having set the status meanwhile: the CAS leaves theirs in place.
+  if (!smooth && getLodLevel() != input.lodLevel)
+    setMeshNeedsUpdate();
+  if (hasPendingMeshWork()) {
+    meshNeedsUpdate = true;
+    state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
+    return;
+  }
+  ChunkState expected = ChunkState::GENERATING;
+  state.status.compare_exchange_strong(expected,
+                                       ChunkState::WAITING_FOR_UPLOAD);
+}
@@ -10,18 +10,20 @@
 #include <array>
 #include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <unordered_map>
 #include <vector>
 
 
+#include "brickMap.hpp"
+#include "chunkVoxels.hpp"
 #include "voxel.hpp"
 
-#define CHUNK_WIDTH 16
-#define CHUNK_HEIGHT 16
-#define CHUNK_DEPTH 16
-
-#define MAX_HEIGHT CHUNK_HEIGHT * 7
+// Terrain height in voxels; fixed in world units so the generated world
+// doesn't change with CHUNK_SIZE.
+#define MAX_HEIGHT 112
 
 enum NeighborDirection : int {
   NEIGHBOR_POS_X = 0, // Right
@@ -32,6 +34,11 @@ enum NeighborDirection : int {
   NEIGHBOR_NEG_Z = 5  // Back
 };
 
+// Offsets to the 12 edge and 8 corner neighbors: the chunks that touch one
+// only along an edge or at a corner.
+constexpr int DIAGONAL_NEIGHBOR_COUNT = 20;
+extern const glm::ivec3 DIAGONAL_OFFSETS[DIAGONAL_NEIGHBOR_COUNT];
+
 enum ChunkState : uint8_t {
   UNINITIALIZED = 0,
   GENERATING = 1,
@@ -41,7 +48,17 @@ enum ChunkState : uint8_t {
   WAITING_FOR_MESH_UPDATE = 5,
 };
 
-inline int getNeighborDirection(int d, int direction) {
+// State-machine flags for one chunk. They live in ChunkRegistry's flag array
+// rather than in Chunk, so the render loop can poll them without touching
+// the (large, worker-written) Chunk object.
+struct ChunkStateFlags {
+  std::atomic<ChunkState> status{ChunkState::UNINITIALIZED};
+  std::atomic<bool> markedForDeletion{false};
+  // Set while the chunk is in the world and visible to the render loop.
+  std::atomic<bool> active{false};
+};
+
+constexpr int getNeighborDirection(int d, int direction) {
   if (d == 0)
     return (direction > 0) ? NEIGHBOR_POS_X : NEIGHBOR_NEG_X;
   if (d == 1)
@@ -49,6 +66,10 @@ inline int getNeighborDirection(int d, int direction) {
   return (direction > 0) ? NEIGHBOR_POS_Z : NEIGHBOR_NEG_Z;
 }
 
+// What a chunk's boundary layer on one side holds. A neighbor's faces on
+// their shared boundary depend on nothing else of this chunk.
+enum class BoundaryFill : uint8_t { EMPTY = 0, MIXED = 1, FULL = 2 };
+
 struct ChunkVertex {
   uint32_t packedData;
 };
@@ -70,50 +91,350 @@ struct ChunkPositionHash {
   }
 };
 
-class Chunk;
+// One published version of a chunk's voxels. Buffers are immutable once
+// published: editors copy, modify and publish a new buffer with the next
+// version, while readers keep whichever buffer they loaded alive.
+//
+// Far-field chunks keep their voxels only as a BrickMap; voxels is then left
+// as all air and must not be read directly.
+struct VoxelBuffer {
+  ChunkVoxels voxels;
+  std::unique_ptr<const BrickMap> bricks;
+  uint64_t version = 0;
+
+  bool isCompact() const { return bricks != nullptr; }
 
-typedef std::unordered_map<glm::ivec3, Chunk *, ChunkPositionHash> ChunkMap;
+  uint8_t get(int x, int y, int z) const {
+    return bricks ? bricks->get(x, y, z)
+                  : voxels.get(ChunkVoxels::toIndex(x, y, z));
+  }
+
+  // The dense voxels; a compact buffer is expanded into scratch.
+  const ChunkVoxels &getDense(ChunkVoxels &scratch) const {
+    if (!bricks)
+      return voxels;
+    scratch = bricks->toVoxels();
+    return scratch;
+  }
+};
+
+typedef std::shared_ptr<const VoxelBuffer> VoxelBufferPtr;
+
+// Continuous terrain field at a world voxel: positive where the terrain is
+// solid, negative where it is empty.
+typedef float (*TerrainDensityFunction)(const glm::ivec3 &worldVoxel);
+
+// Everything a mesh job reads, each pinned at the version it was loaded at.
+struct ChunkMeshSources {
+  VoxelBufferPtr self;
+  // Null where no neighbor is linked. Order: +X, -X, +Y, -Y, +Z, -Z
+  VoxelBufferPtr neighbors[6];
+  // Likewise, in DIAGONAL_OFFSETS order.
+  VoxelBufferPtr diagonals[DIAGONAL_NEIGHBOR_COUNT];
+  // Level of detail to mesh at (see Chunk::getLodLevel).
+  int lodLevel;
+  // Set to mesh smooth terrain (see SurfaceNets); null for blocks.
+  TerrainDensityFunction smoothDensity = nullptr;
+};
+
+// Coarsest level of detail: blocks of 2^MAX_LOD_LEVEL voxels per side.
+#define MAX_LOD_LEVEL 3
+static_assert((1 << MAX_LOD_LEVEL) <= CHUNK_SIZE,
+              "the coarsest LOD block must fit in a chunk");
+
+#define PADDED_CHUNK_SIZE (CHUNK_DEPTH + 2)
+
+// Padded occupancy column: bit z + 1 is set when voxel (x, y, z) is solid;
+// bits 0 and CHUNK_DEPTH + 1 carry the -Z / +Z neighbors' border voxels.
+typedef ChunkBitsType<PADDED_CHUNK_SIZE> PaddedColumn;
+static_assert(sizeof(PaddedColumn) * 8 >= PADDED_CHUNK_SIZE,
+              "PaddedColumn must hold a column plus both border bits");
+
+// Meshing input: the chunk's voxels plus one layer from each of its six
+// neighbors, indexed [x + 1][y + 1][z + 1]. It is copied once while the
+// neighbor links are stable, so the mesh kernel never branches on chunk
+// bounds or reads another chunk. The edge and corner cells come from the
+// edge and corner neighbors; only the baked occlusion of faces along the
+// chunk's edges reads them. A missing neighbor reads as air.
+struct ChunkMeshInput {
+  uint8_t voxels[PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE];
+  PaddedColumn columns[PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE];
+  // Solid voxels in each neighbor's border layer. Order: +X, -X, +Y, -Y, +Z, -Z
+  int borderSolidCount[6];
+  bool singleSolidID;
+  bool uniform;
+  uint8_t uniformID;
+  // Version of the chunk's own VoxelBuffer this input was built from.
+  uint64_t version;
+  // Level of detail the chunk's own voxels were coarsened to.
+  int lodLevel;
+  // Copied from ChunkMeshSources.
+  TerrainDensityFunction smoothDensity;
+};
+
+// 128-bit content key of a ChunkMeshInput (see MeshCache). The all-zero key
+// means "no key".
+struct MeshKey {
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+
+  bool isNull() const { return lo == 0 && hi == 0; }
+  bool operator==(const MeshKey &other) const {
+    return lo == other.lo && hi == other.hi;
+  }
+};
+
+struct MeshKeyHash {
+  size_t operator()(const MeshKey &key) const noexcept {
+    return (size_t)(key.lo ^ key.hi);
+  }
+};
+
+// One finished chunk mesh. Immutable once built, so chunks whose mesh input
+// is identical can share a single one.
+//
+// The quads are cut into slices, one per face direction and layer along its
+// axis: slice s = face * CHUNK_DEPTH + layer (face is a Voxel::VoxelFace)
+// holds quads[sliceOffsets[s] .. sliceOffsets[s + 1]).
+struct ChunkMesh {
+  std::vector<Voxel::PackedVoxel> quads;
+  uint32_t sliceOffsets[6 * CHUNK_DEPTH + 1] = {};
+  // Content key of the input it was built from when it is shared through a
+  // MeshCache; null for meshes patched by an edit, which are never shared.
+  MeshKey key;
+
+  // Smooth meshes (see SurfaceNets) have no quads: they are triangles
+  // indexing into smoothVertices.
+  std::vector<Voxel::PackedSmoothVertex> smoothVertices;
+  std::vector<uint16_t> smoothIndices;
+};
+
+typedef std::shared_ptr<const ChunkMesh> ChunkMeshPtr;
+
+class Chunk;
+class MeshCache;
 
 class Chunk {
 private:
-  uint8_t voxelIDs[CHUNK_WIDTH][CHUNK_HEIGHT][CHUNK_DEPTH];
-  std::vector<Voxel::PackedVoxel> meshData;
-  bool meshNeedsUpdate;
+  // Current voxel buffer; always read and replaced with std::atomic_load /
+  // std::atomic_store. editMutex only serializes editors against each other.
+  VoxelBufferPtr voxelBuffer;
+  std::mutex editMutex;
+
+  // Held by generateMesh for the whole job, so mesh jobs on one chunk never
+  // overlap, and by the upload while it reads the mesh.
+  std::mutex meshMutex;
+  // Never null. A single-voxel edit only changes a few of its slices, so
+  // only those are remeshed.
+  ChunkMeshPtr mesh;
+  // mesh->quads[meshDirtyBegin, meshDirtyEnd) changed since the last upload.
+  uint32_t meshDirtyBegin = 0;
+  uint32_t meshDirtyEnd = 0;
+  // Time of the oldest edit the not-yet-uploaded mesh includes; 0 if none.
+  int64_t meshEditTime = 0;
+  // mesh hasn't been uploaded yet, e.g. because more work arrived while it
+  // was built and the chunk went straight back to WAITING_FOR_MESH_UPDATE.
+  bool meshUploadPending = false;
+  // Level of detail mesh was built at.
+  int meshLodLevel = 0;
+  // Whether mesh is a smooth one.
+  bool meshSmooth = false;
+  // mesh was dropped after upload (see releaseMeshData) and no longer
+  // matches what the GPU draws.
+  bool meshDataReleased = false;
+  std::atomic<bool> keepMeshData{false};
+
+  std::atomic<bool> meshNeedsUpdate;
+  // Work for the next mesh job: either a full remesh, or just the slices
+  // flagged here (bit = layer, per face).
+  std::atomic<bool> fullRemeshNeeded{true};
+  std::atomic<ChunkColumn> dirtySlices[6]{};
+  bool hasPendingMeshWork() const;
+  // skipMeshJob with meshMutex held.
+  void skipMeshJobLocked();
+  // Steady-clock time (ns) of the oldest edit not yet meshed; 0 if none.
+  std::atomic<int64_t> pendingEditTime{0};
+  // Mirrors voxelBuffer->isCompact() without the shared_ptr atomic load.
+  std::atomic<bool> compact{false};
+  std::atomic<uint8_t> lodLevel{0};
+  // BoundaryFill of each side, 2 bits per NeighborDirection; set on publish.
+  std::atomic<uint16_t> boundaryFills{0};
+
+  void publishLocked(ChunkVoxels &&voxels, uint64_t version);
+  // Flags the slices of face that must be remeshed.
+  void markSlicesDirty(int face, ChunkColumn layers) {
+    dirtySlices[face].fetch_or(layers);
+  }
+  // Flags the slices that read the neighbor in direction and queues a mesh
+  // job: faces on the boundary layer facing it, and, for their baked
+  // occlusion, the other four faces on sideLayers (per axis; direction's
+  // own axis is ignored).
+  void markBoundarySlicesDirty(int direction, const ChunkColumn sideLayers[3]);
+  // Flags the slices whose occlusion reads the edge or corner neighbor at
+  // offset and queues a mesh job: faces on the boundary layers towards it,
+  // and along an edge's own axis, faces on sideLayers.
+  void markDiagonalSlicesDirty(const glm::ivec3 &offset,
+                               const ChunkColumn sideLayers[3]);
 
   // Order: +X, -X, +Y, -Y, +Z, -Z
   std::atomic<Chunk *> neighbors[6]{nullptr};
+  // Edge and corner neighbors, indexed by getDiagonalSlot(offset). The
+  // center and face entries stay null.
+  std::atomic<Chunk *> diagonalNeighbors[27]{nullptr};
+  static int getDiagonalSlot(const glm::ivec3 &offset) {
+    return (offset.x + 1) * 9 + (offset.y + 1) * 3 + (offset.z + 1);
+  }
 
-  bool shouldRenderFace(int x, int y, int z, int d, int direction) const;
-  void greedyMeshAxis(std::vector<Voxel::PackedVoxel> &meshData, int d, int u,
-                      int v, int direction, Voxel::VoxelFace faceDir);
+  // Faces along axis D (0 = x, 1 = y, 2 = z) whose normal points towards
+  // DIRECTION (+1 or -1). Instantiated once per face in chunk.cpp.
+  //
+  // greedyMeshSlice: meshes one layer from its face-mask rows (consumed).
+  template <int D, int DIRECTION>
+  static void greedyMeshSlice(std::vector<Voxel::PackedVoxel> &meshData,
+                              const ChunkMeshInput &input,
+                              ChunkColumn rows[CHUNK_DEPTH], int layer);
+  // meshFace: appends the face's slices to newMesh. Layers set in `layers`
+  // are meshed from input; the rest are copied from the current mesh.
+  template <int D, int DIRECTION>
+  void meshFace(ChunkMesh &newMesh, const ChunkMeshInput &input,
+                ChunkColumn layers) const;
 
 public:
   glm::ivec3 chunkPosition;
-  ChunkState status;
-  std::atomic<bool> markedForDeletion{false};
-
-  unsigned int VAO;
-  unsigned int VBO;
-  bool glResourcesInitialized;
+  // Dense ChunkRegistry index; the chunk's GL objects and cull position live
+  // in the registry's arrays under this slot.
+  const uint32_t registrySlot;
+  // This chunk's entry in the registry's flag array.
+  ChunkStateFlags &state;
 
-  Chunk(glm::ivec3 position);
-  ~Chunk();
+  Chunk(glm::ivec3 position, uint32_t registrySlot, ChunkStateFlags &state);
+  // Single-voxel edit: copies the current buffer, applies the change and
+  // publishes it as a new version. Never waits on a mesh job.
   void setVoxel(int x, int y, int z, uint8_t voxelID);
   uint8_t getVoxel_ID(int x, int y, int z) const;
+  void fill(uint8_t voxelID);
+  // Publishes a whole voxel set at once (e.g. freshly generated terrain).
+  void publishVoxels(ChunkVoxels &&voxels);
+
+  VoxelBufferPtr getVoxelSnapshot() const {
+    return std::atomic_load(&voxelBuffer);
+  }
+  uint64_t getVoxelVersion() const { return getVoxelSnapshot()->version; }
+  bool isUniform() const {
+    VoxelBufferPtr buffer = getVoxelSnapshot();
+    return buffer->bricks ? buffer->bricks->isUniform()
+                          : buffer->voxels.isUniform();
+  }
+  uint8_t getUniformVoxel_ID() const {
+    VoxelBufferPtr buffer = getVoxelSnapshot();
+    return buffer->bricks ? buffer->bricks->getUniformID()
+                          : buffer->voxels.getUniformID();
+  }
+
+  // Far-field storage: compactVoxels() swaps the dense voxels for a
+  // BrickMap and expandVoxels() swaps them back. Neither changes the
+  // content or version, so meshes stay valid. Uniform chunks stay dense;
+  // they are already as small as a BrickMap.
+  void compactVoxels();
+  void expandVoxels();
+  bool isCompact() const { return compact.load(std::memory_order_relaxed); }
   uint8_t getAdjChunkVoxel_ID(Voxel::VoxelFace adjChunkDir, int x, int y,
                               int z) const;
+  // Level of detail: 0 meshes every voxel; level L meshes blocks of 2^L
+  // voxels per side (see captureMeshInput). Changing it asks for a full
+  // remesh.
+  int getLodLevel() const { return lodLevel.load(std::memory_order_relaxed); }
+  void setLodLevel(int level) {
+    if (lodLevel.exchange((uint8_t)level) != level)
+      setMeshNeedsUpdate();
+  }
+
   bool getMeshNeedsUpdate() const { return meshNeedsUpdate; }
-  void setMeshNeedsUpdate() { meshNeedsUpdate = true; }
+  // Asks for a full remesh (e.g. a neighbor was linked or unlinked).
+  // setVoxel instead flags only the slices around the edit.
+  void setMeshNeedsUpdate() {
+    fullRemeshNeeded = true;
+    meshNeedsUpdate = true;
+  }
 
-  void generateMesh();
-  void initGLResources();
-  bool updateVBO();
-  void bindAndDraw();
+  // Pins the current buffer of this chunk and of each linked neighbor. The
+  // caller must keep the neighbors allocated for the duration (WorldManager
+  // has an epoch pinned); everything after works on the pinned buffers.
+  void gatherMeshSources(ChunkMeshSources &sources) const;
+  // Copies the pinned chunk and its neighbors' border layers into input,
+  // coarsening the chunk's own voxels to sources.lodLevel. The borders stay
+  // at full resolution.
+  static void captureMeshInput(const ChunkMeshSources &sources,
+                               ChunkMeshInput &input);
+  // Takes the pending work, then captures the chunk and its linked
+  // neighbors into input (scratch space for the job) and meshes it; pass
+  // smoothDensity for smooth terrain. The caller keeps the neighbors
+  // allocated, as for gatherMeshSources. If the chunk's voxels were edited
+  // after the capture, the result is dropped and the chunk goes back to
+  // WAITING_FOR_MESH_UPDATE. After a setVoxel only the flagged slices are
+  // remeshed and spliced into the current mesh. Full remeshes go through
+  // cache when one is given, so chunks with identical input share one
+  // mesh. Work flagged while the job ran, here or by a neighbor, sends the
+  // chunk back to WAITING_FOR_MESH_UPDATE rather than WAITING_FOR_UPLOAD;
+  // the next job's mesh is uploaded in its place.
+  void generateMesh(ChunkMeshInput &input, MeshCache *cache = nullptr,
+                    TerrainDensityFunction smoothDensity = nullptr);
+  // For a queued mesh job with nothing left to do (an earlier job took the
+  // work): hands back a mesh still waiting for upload, or goes IDLE.
+  void skipMeshJob();
 
-  size_t getVertexCount() const {
-    return meshNeedsUpdate ? 0 : meshData.size();
+  // Latest finished mesh; ChunkRegistry::uploadMesh copies it to the GPU
+  // once status reaches WAITING_FOR_UPLOAD. Read these with getMeshMutex()
+  // held.
+  std::mutex &getMeshMutex() { return meshMutex; }
+  const ChunkMeshPtr &getMesh() const { return mesh; }
+  const std::vector<Voxel::PackedVoxel> &getMeshData() const {
+    return mesh->quads;
+  }
+  // Once uploaded, the mesh is only needed on the CPU to splice the next
+  // edit into, so the upload drops it (the next remesh is then a full one)
+  // unless it came from an edit, is held by the MeshCache, or the chunk opts
+  // to keep it, e.g. to save or coarsen it.
+  void setKeepMeshData(bool keep) {
+    keepMeshData.store(keep, std::memory_order_relaxed);
+  }
+  bool getKeepMeshData() const {
+    return keepMeshData.load(std::memory_order_relaxed);
+  }
+  void releaseMeshData();
+  // Start of face f's quads; face 6 is the end of the mesh.
+  uint32_t getMeshFaceOffset(int face) const {
+    return mesh->sliceOffsets[face * CHUNK_DEPTH];
+  }
+  // Quads changed since the last upload, and the oldest edit (steady-clock
+  // ns, 0 if none) they include. The upload clears both.
+  uint32_t getMeshDirtyBegin() const { return meshDirtyBegin; }
+  uint32_t getMeshDirtyEnd() const { return meshDirtyEnd; }
+  int64_t getMeshEditTime() const { return meshEditTime; }
+  void clearMeshDirty() {
+    meshDirtyBegin = meshDirtyEnd = 0;
+    meshEditTime = 0;
+    meshUploadPending = false;
   }
 
+  BoundaryFill getBoundaryFill(int direction) const {
+    return (BoundaryFill)((boundaryFills.load(std::memory_order_acquire) >>
+                           (2 * direction)) &
+                          3);
+  }
+  // The neighbor in direction was linked or unlinked; neighborFill is its
+  // boundary layer facing this chunk. Rebuilds only the slices that read
+  // it, and only when the mesh can change: an empty neighbor layer reads
+  // the same as no neighbor, and an empty own layer has no faces there.
+  // Returns whether a remesh was queued.
+  bool neighborBoundaryChanged(int direction, BoundaryFill neighborFill);
+  // The edge or corner neighbor at offset, which has solid voxels towards
+  // this chunk, was linked or unlinked. Rebuilds the slices whose occlusion
+  // reads it.
+  void diagonalBoundaryChanged(const glm::ivec3 &offset);
+  // Whether any voxel on the edge or at the corner towards offset is solid.
+  bool hasSolidEdge(const glm::ivec3 &offset) const;
+
   // Neighbor calls
   void setNeighbor(int direction, Chunk *neighbor) {
     neighbors[direction].store(neighbor, std::memory_order_release);
@@ -127,9 +448,25 @@ public:
     neighbors[direction].store(nullptr, std::memory_order_release);
   }
 
+  void setDiagonalNeighbor(const glm::ivec3 &offset, Chunk *neighbor) {
+    diagonalNeighbors[getDiagonalSlot(offset)].store(
+        neighbor, std::memory_order_release);
+  }
+
+  Chunk *getDiagonalNeighbor(const glm::ivec3 &offset) const {
+    return diagonalNeighbors[getDiagonalSlot(offset)].load(
+        std::memory_order_acquire);
+  }
+
+  void clearDiagonalNeighbor(const glm::ivec3 &offset) {
+    setDiagonalNeighbor(offset, nullptr);
+  }
+
   void clearAllNeighbors() {
     for (int i = 0; i < 6; ++i) {
       neighbors[i].store(nullptr, std::memory_order_release);
     }
+    for (std::atomic<Chunk *> &diagonal : diagonalNeighbors)
+      diagonal.store(nullptr, std::memory_order_release);
   }
 };
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "chunkGrid.hpp"
+
+ChunkGrid::ChunkGrid(const glm::ivec3 &below, const glm::ivec3 &above)
+    : below(below), above(above), extent(below + above + 1),
+      slotCount((size_t)extent.x * extent.y * extent.z),
+      slots(new std::atomic<Chunk *>[slotCount]) {
+  for (size_t i = 0; i < slotCount; ++i)
+    slots[i].store(nullptr, std::memory_order_relaxed);
+}
+
+void ChunkGrid::setOrigin(const glm::ivec3 &newOrigin) {
+  origin = newOrigin;
+  originSet = true;
+}
+
+bool ChunkGrid::contains(const glm::ivec3 &pos) const {
+  if (!originSet)
+    return false;
+  glm::ivec3 min, max;
+  getWindow(origin, min, max);
+  return glm::all(glm::greaterThanEqual(pos, min)) &&
+         glm::all(glm::lessThanEqual(pos, max));
+}
+
+bool ChunkGrid::insert(Chunk *chunk) {
+  const glm::ivec3 &pos = chunk->chunkPosition;
+  if (!contains(pos))
+    return false;
+  Chunk *expected = nullptr;
+  if (!slots[indexOf(pos)].compare_exchange_strong(expected, chunk))
+    return false;
+  count.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void ChunkGrid::erase(const glm::ivec3 &pos) {
+  if (!contains(pos))
+    return;
+  if (slots[indexOf(pos)].exchange(nullptr) != nullptr)
+    count.fetch_sub(1, std::memory_order_relaxed);
+}
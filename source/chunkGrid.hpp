@@ -0,0 +1,74 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// The loaded chunks, in a toroidal grid: a window of chunk positions
+// around an origin (the camera chunk), each stored at its position modulo
+// the window's extent. The window only ever holds positions inside it, so
+// no two share a slot; looking up a position or a neighbor is index
+// arithmetic, iterating walks one flat array, and moving the window only
+// has to look at the shell of positions leaving it.
+//
+// The slots are atomic: with WorldManager's chunk_map_mutex held shared,
+// any number of threads may get, insert and erase at once, so loads don't
+// serialize on the map. Moving the window (setOrigin) takes the mutex
+// exclusively. All slot accesses are sequentially consistent, so of two
+// threads that each insert a chunk and then get the other's position, at
+// least one finds the other's chunk.
+class ChunkGrid {
+public:
+  // A window from origin - below to origin + above on each axis.
+  ChunkGrid(const glm::ivec3 &below, const glm::ivec3 &above);
+  ChunkGrid(const ChunkGrid &) = delete;
+  ChunkGrid &operator=(const ChunkGrid &) = delete;
+
+  // The positions the window covers at origin: [min, max] inclusive.
+  void getWindow(const glm::ivec3 &origin, glm::ivec3 &min,
+                 glm::ivec3 &max) const {
+    min = origin - below;
+    max = origin + above;
+  }
+  bool hasOrigin() const { return originSet; }
+  const glm::ivec3 &getOrigin() const { return origin; }
+  // Every chunk outside the new window must have been erased first. Until
+  // the first call the window is empty.
+  void setOrigin(const glm::ivec3 &newOrigin);
+  bool contains(const glm::ivec3 &pos) const;
+
+  // nullptr if nothing is loaded at pos (or pos is outside the window).
+  Chunk *get(const glm::ivec3 &pos) const {
+    return contains(pos) ? slots[indexOf(pos)].load() : nullptr;
+  }
+  // Stores chunk at its position; false if that is outside the window or
+  // already taken (by a concurrent insert, say).
+  bool insert(Chunk *chunk);
+  void erase(const glm::ivec3 &pos);
+
+  size_t size() const { return count.load(std::memory_order_relaxed); }
+  size_t getSlotCount() const { return slotCount; }
+
+  // Calls f(Chunk *) for every loaded chunk, in slot order.
+  template <typename F> void forEach(F &&f) const {
+    for (size_t i = 0; i < slotCount; ++i)
+      if (Chunk *chunk = slots[i].load(std::memory_order_acquire))
+        f(chunk);
+  }
+
+private:
+  size_t indexOf(const glm::ivec3 &pos) const {
+    glm::ivec3 wrapped = ((pos % extent) + extent) % extent;
+    return ((size_t)wrapped.x * extent.y + wrapped.y) * extent.z + wrapped.z;
+  }
+
+  const glm::ivec3 below;
+  const glm::ivec3 above;
+  const glm::ivec3 extent;
+  glm::ivec3 origin{0};
+  bool originSet = false;
+  const size_t slotCount;
+  std::unique_ptr<std::atomic<Chunk *>[]> slots;
+  std::atomic<size_t> count{0};
+};
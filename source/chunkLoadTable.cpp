@@ -0,0 +1,54 @@
+#include "chunkLoadTable.hpp"
+#include <algorithm>
+
+ChunkLoadState ChunkLoadTable::get(const glm::ivec3 &chunkPos) const {
+  auto it = regions.find(regionOf(chunkPos));
+  if (it == regions.end())
+    return ChunkLoadState::UNKNOWN;
+  return it->second->states[indexInRegion(chunkPos)];
+}
+
+void ChunkLoadTable::set(const glm::ivec3 &chunkPos, ChunkLoadState state) {
+  glm::ivec3 region = regionOf(chunkPos);
+  auto it = regions.find(region);
+  if (it == regions.end()) {
+    if (state == ChunkLoadState::UNKNOWN)
+      return;
+    // Value-initialized: every position UNKNOWN.
+    it = regions.emplace(region, std::unique_ptr<Region>(new Region())).first;
+    counts[(int)ChunkLoadState::UNKNOWN] += REGION_VOLUME;
+  }
+  ChunkLoadState &slot = it->second->states[indexInRegion(chunkPos)];
+  counts[(int)slot]--;
+  counts[(int)state]++;
+  slot = state;
+}
+
+void ChunkLoadTable::releaseOutside(const glm::ivec3 &min,
+                                    const glm::ivec3 &max) {
+  const glm::ivec3 regionMin = regionOf(min);
+  const glm::ivec3 regionMax = regionOf(max);
+  for (auto it = regions.begin(); it != regions.end();) {
+    const glm::ivec3 &region = it->first;
+    if (glm::all(glm::greaterThanEqual(region, regionMin)) &&
+        glm::all(glm::lessThanEqual(region, regionMax))) {
+      ++it;
+      continue;
+    }
+    // A position still QUEUED has a load in flight, and forgetting it would
+    // let the scheduler queue it again; keep the region until it resolves.
+    const ChunkLoadState *states = it->second->states;
+    bool live = std::any_of(states, states + REGION_VOLUME,
+                            [](ChunkLoadState state) {
+                              return state == ChunkLoadState::QUEUED ||
+                                     state == ChunkLoadState::LOADED;
+                            });
+    if (live) {
+      ++it;
+      continue;
+    }
+    for (int i = 0; i < REGION_VOLUME; ++i)
+      counts[(int)states[i]]--;
+    it = regions.erase(it);
+  }
+}
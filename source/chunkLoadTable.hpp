@@ -0,0 +1,69 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+// Where a chunk position is in loading. UNKNOWN is the state of every
+// position the table has no storage for.
+enum class ChunkLoadState : uint8_t {
+  UNKNOWN = 0, // never looked at, or forgotten
+  QUEUED = 1,  // waiting for a load task, or being loaded
+  EMPTY = 2,   // generated empty: there is no Chunk
+  LOADED = 3,  // in the chunk map
+};
+
+// Load state of every chunk position around the camera, one byte each.
+//
+// Positions are grouped into regions of REGION_SIZE^3 chunks, allocated on
+// first write, so a lookup is one hash of the region plus an index into it.
+// Regions wholly outside the range the world keeps are freed in one go
+// (releaseOutside), which bounds memory by the view volume however far the
+// camera travels.
+//
+// Not synchronized; WorldManager guards it with loadingMutex.
+class ChunkLoadTable {
+public:
+  static constexpr int REGION_BITS = 4;
+  static constexpr int REGION_SIZE = 1 << REGION_BITS;
+  static constexpr int REGION_VOLUME = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+
+  ChunkLoadTable() = default;
+  ChunkLoadTable(const ChunkLoadTable &) = delete;
+  ChunkLoadTable &operator=(const ChunkLoadTable &) = delete;
+
+  ChunkLoadState get(const glm::ivec3 &chunkPos) const;
+  // Setting UNKNOWN where there is no region doesn't allocate one.
+  void set(const glm::ivec3 &chunkPos, ChunkLoadState state);
+
+  // Frees every region with no position in [min, max] (chunk positions,
+  // inclusive) and none QUEUED or LOADED; their positions go back to
+  // UNKNOWN.
+  void releaseOutside(const glm::ivec3 &min, const glm::ivec3 &max);
+
+  size_t getCount(ChunkLoadState state) const {
+    return counts[(int)state];
+  }
+  size_t getRegionCount() const { return regions.size(); }
+  size_t getMemoryUsage() const { return regions.size() * sizeof(Region); }
+
+private:
+  struct Region {
+    ChunkLoadState states[REGION_VOLUME];
+  };
+
+  static glm::ivec3 regionOf(const glm::ivec3 &chunkPos) {
+    return chunkPos >> REGION_BITS;
+  }
+  static int indexInRegion(const glm::ivec3 &chunkPos) {
+    glm::ivec3 local = chunkPos & (REGION_SIZE - 1);
+    return (local.x * REGION_SIZE + local.y) * REGION_SIZE + local.z;
+  }
+
+  std::unordered_map<glm::ivec3, std::unique_ptr<Region>, ChunkPositionHash>
+      regions;
+  // Positions in each state, UNKNOWN only counting those with storage.
+  size_t counts[4] = {};
+};
@@ -0,0 +1,125 @@
+#include "chunkPool.hpp"
+#include <new>
+#include <sys/mman.h>
+
+#if defined(__APPLE__)
+#include <mach/vm_statistics.h>
+#endif
+
+ChunkPool::ChunkPool(size_t slotCount, bool useHugePages) : capacity(slotCount) {
+  // Round slots up to a cache line so neighbouring chunks never share one.
+  slotSize = (sizeof(Chunk) + 63) & ~size_t(63);
+  slabBytes = slotSize * capacity;
+
+#if defined(__APPLE__) && defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+  if (useHugePages) {
+    const size_t superPage = 2 * 1024 * 1024;
+    size_t rounded = (slabBytes + superPage - 1) & ~(superPage - 1);
+    void *p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
+    if (p != MAP_FAILED) {
+      slab = static_cast<unsigned char *>(p);
+      slabBytes = rounded;
+      hugePages = true;
+    }
+  }
+#endif
+
+  if (slab == nullptr) {
+    void *p = mmap(nullptr, slabBytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      // No slab at all: every acquire() overflows to the heap.
+      slabBytes = 0;
+      capacity = 0;
+    } else {
+      slab = static_cast<unsigned char *>(p);
+#if defined(MADV_HUGEPAGE)
+      if (useHugePages)
+        hugePages = madvise(slab, slabBytes, MADV_HUGEPAGE) == 0;
+#endif
+    }
+  }
+
+  nextFree.reset(new std::atomic<uint32_t>[capacity > 0 ? capacity : 1]);
+}
+
+ChunkPool::~ChunkPool() {
+  if (slab != nullptr)
+    munmap(slab, slabBytes);
+}
+
+size_t ChunkPool::capacityForRenderDistance(int renderDistance,
+                                            int verticalChunks) {
+  // Chunks stay loaded out to RENDER_DISTANCE + 4 horizontally and two
+  // chunks past the vertical band (WorldManager's chunk grid window), so
+  // size for all of it. Plenty of the window never holds terrain, which
+  // leaves room for unloaded chunks waiting a frame in the delete queue.
+  size_t side = 2 * (size_t)(renderDistance + 4) + 1;
+  return side * side * (size_t)(verticalChunks + 4);
+}
+
+void *ChunkPool::popFreeSlot() {
+  uint64_t head = freeHead.load(std::memory_order_acquire);
+  while ((head & INDEX_MASK) != 0) {
+    uint32_t index = (uint32_t)(head & INDEX_MASK) - 1;
+    uint32_t next = nextFree[index].load(std::memory_order_relaxed);
+    uint64_t newHead = ((head >> 32) + 1) << 32 | next;
+    if (freeHead.compare_exchange_weak(head, newHead,
+                                       std::memory_order_acquire,
+                                       std::memory_order_acquire))
+      return slotAddress(index);
+  }
+  return nullptr;
+}
+
+void ChunkPool::pushFreeSlot(uint32_t index) {
+  uint64_t head = freeHead.load(std::memory_order_relaxed);
+  uint64_t newHead;
+  do {
+    nextFree[index].store((uint32_t)(head & INDEX_MASK),
+                          std::memory_order_relaxed);
+    newHead = ((head >> 32) + 1) << 32 | (uint64_t)(index + 1);
+  } while (!freeHead.compare_exchange_weak(head, newHead,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed));
+}
+
+Chunk *ChunkPool::acquire(glm::ivec3 position, uint32_t registrySlot,
+                          ChunkStateFlags &state) {
+  void *slot = popFreeSlot();
+
+  if (slot == nullptr && nextFresh.load(std::memory_order_relaxed) < capacity) {
+    uint32_t index = nextFresh.fetch_add(1, std::memory_order_relaxed);
+    if (index < capacity)
+      slot = slotAddress(index);
+  }
+
+  size_t used = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+  size_t high = highWaterMark.load(std::memory_order_relaxed);
+  while (used > high && !highWaterMark.compare_exchange_weak(
+                            high, used, std::memory_order_relaxed))
+    ;
+
+  if (slot == nullptr) {
+    overflowCount.fetch_add(1, std::memory_order_relaxed);
+    return new Chunk(position, registrySlot, state);
+  }
+  return new (slot) Chunk(position, registrySlot, state);
+}
+
+void ChunkPool::release(Chunk *chunk) {
+  if (chunk == nullptr)
+    return;
+
+  inUse.fetch_sub(1, std::memory_order_relaxed);
+
+  if (!ownsChunk(chunk)) {
+    delete chunk;
+    return;
+  }
+
+  chunk->~Chunk();
+  size_t offset = reinterpret_cast<unsigned char *>(chunk) - slab;
+  pushFreeSlot((uint32_t)(offset / slotSize));
+}
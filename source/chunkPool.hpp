@@ -0,0 +1,76 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Fixed-capacity slab of Chunk objects with recycled slots.
+//
+// The slab is one virtual reservation sized for the whole view volume; pages
+// only become resident as slots are first handed out. acquire() takes a slot
+// from the free list (a tagged Treiber stack) or bumps into fresh slab space,
+// and release() destroys the chunk and pushes its slot back, both lock-free.
+// If the slab is ever exhausted acquire() falls back to the heap and release()
+// recognises those chunks by address.
+class ChunkPool {
+public:
+  ChunkPool(size_t slotCount, bool useHugePages = false);
+  ~ChunkPool();
+
+  ChunkPool(const ChunkPool &) = delete;
+  ChunkPool &operator=(const ChunkPool &) = delete;
+
+  // Slots needed for every chunk WorldManager can keep loaded at once, for a
+  // load band verticalChunks chunks tall.
+  static size_t capacityForRenderDistance(int renderDistance,
+                                          int verticalChunks);
+
+  Chunk *acquire(glm::ivec3 position, uint32_t registrySlot,
+                 ChunkStateFlags &state);
+
+  // Runs ~Chunk. Chunks own no GL objects (their registry slot does), so
+  // any thread may release them.
+  void release(Chunk *chunk);
+
+  size_t getCapacity() const { return capacity; }
+  size_t getInUse() const { return inUse.load(std::memory_order_relaxed); }
+  size_t getHighWaterMark() const {
+    return highWaterMark.load(std::memory_order_relaxed);
+  }
+  size_t getOverflowCount() const {
+    return overflowCount.load(std::memory_order_relaxed);
+  }
+  bool isUsingHugePages() const { return hugePages; }
+
+private:
+  // Free-list head: slot index + 1 in the low 32 bits (0 = empty), and a
+  // generation tag in the high 32 bits that defeats ABA on pop.
+  static constexpr uint64_t INDEX_MASK = 0xFFFFFFFFull;
+
+  void *slotAddress(uint32_t index) const {
+    return slab + (size_t)index * slotSize;
+  }
+  bool ownsChunk(const Chunk *chunk) const {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(chunk);
+    return p >= slab && p < slab + slabBytes;
+  }
+
+  void *popFreeSlot();
+  void pushFreeSlot(uint32_t index);
+
+  unsigned char *slab = nullptr;
+  size_t slabBytes = 0;
+  size_t slotSize = 0;
+  size_t capacity = 0;
+  bool hugePages = false;
+
+  std::unique_ptr<std::atomic<uint32_t>[]> nextFree;
+  std::atomic<uint64_t> freeHead{0};
+  std::atomic<uint32_t> nextFresh{0};
+
+  std::atomic<size_t> inUse{0};
+  std::atomic<size_t> highWaterMark{0};
+  std::atomic<size_t> overflowCount{0};
+};
@@ -0,0 +1,266 @@
+#include "chunkRegistry.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+ChunkRegistry::ChunkRegistry(size_t capacity)
+    : capacity(capacity), cullPositions(new glm::vec3[capacity]()),
+      renderRecords(new ChunkRenderRecord[capacity]()),
+      stateFlags(new ChunkStateFlags[capacity]),
+      payloads(new Chunk *[capacity]()) {}
+
+ChunkRegistry::~ChunkRegistry() {
+  uint32_t end = getSlotEnd();
+  for (uint32_t slot = 0; slot < end; ++slot)
+    releaseBuffers(renderRecords[slot]);
+}
+
+// A VAO reading one packed quad per instance from a fresh VBO.
+static void createQuadBuffers(GLuint &VAO, GLuint &VBO) {
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glEnableVertexAttribArray(0);
+  glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void *)0);
+  glVertexAttribDivisor(0, 1);
+}
+
+// A VAO reading indexed smooth vertices from a fresh VBO and EBO.
+static void createSmoothBuffers(GLuint &VAO, GLuint &VBO, GLuint &EBO) {
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glEnableVertexAttribArray(0);
+  glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT,
+                         sizeof(Voxel::PackedSmoothVertex), (void *)0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+}
+
+void ChunkRegistry::releaseBuffers(ChunkRenderRecord &record) {
+  if (record.sharedBuffer != 0) {
+    uint32_t index = record.sharedBuffer - 1;
+    SharedMeshBuffer &shared = sharedBuffers[index];
+    sharedBufferUsers--;
+    if (--shared.refCount == 0) {
+      glDeleteVertexArrays(1, &shared.VAO);
+      glDeleteBuffers(1, &shared.VBO);
+      sharedBufferIndex.erase(shared.key);
+      freeSharedBuffers.push_back(index);
+    }
+  } else if (record.VAO != 0) {
+    glDeleteVertexArrays(1, &record.VAO);
+    glDeleteBuffers(1, &record.VBO);
+    if (record.EBO != 0)
+      glDeleteBuffers(1, &record.EBO);
+  }
+  record.VAO = 0;
+  record.VBO = 0;
+  record.EBO = 0;
+  record.vboCapacity = 0;
+  record.sharedBuffer = 0;
+  record.indexCount = 0;
+}
+
+void ChunkRegistry::uploadSmoothMesh(ChunkRenderRecord &record,
+                                     const ChunkMesh &mesh) {
+  // Coming from a quad mesh: its VAO reads the wrong vertex format.
+  if (record.VAO != 0 && record.EBO == 0)
+    releaseBuffers(record);
+  if (record.VAO == 0)
+    createSmoothBuffers(record.VAO, record.VBO, record.EBO);
+
+  // A smooth mesh is rebuilt whole every time, so it is sent whole.
+  glBindVertexArray(record.VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, record.VBO);
+  glBufferData(GL_ARRAY_BUFFER,
+               mesh.smoothVertices.size() * sizeof(Voxel::PackedSmoothVertex),
+               mesh.smoothVertices.data(), GL_DYNAMIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               mesh.smoothIndices.size() * sizeof(uint16_t),
+               mesh.smoothIndices.data(), GL_DYNAMIC_DRAW);
+  record.indexCount = (uint32_t)mesh.smoothIndices.size();
+  std::fill(record.faceOffsets, record.faceOffsets + 7, 0u);
+}
+
+void ChunkRegistry::bindSharedBuffer(ChunkRenderRecord &record,
+                                     const ChunkMesh &mesh) {
+  auto it = sharedBufferIndex.find(mesh.key);
+  if (record.sharedBuffer != 0 && it != sharedBufferIndex.end() &&
+      it->second == record.sharedBuffer - 1)
+    return;
+
+  releaseBuffers(record);
+  uint32_t index;
+  if (it != sharedBufferIndex.end()) {
+    index = it->second;
+  } else {
+    if (!freeSharedBuffers.empty()) {
+      index = freeSharedBuffers.back();
+      freeSharedBuffers.pop_back();
+    } else {
+      index = (uint32_t)sharedBuffers.size();
+      sharedBuffers.emplace_back();
+    }
+    SharedMeshBuffer &shared = sharedBuffers[index];
+    createQuadBuffers(shared.VAO, shared.VBO);
+    glBufferData(GL_ARRAY_BUFFER,
+                 mesh.quads.size() * sizeof(Voxel::PackedVoxel),
+                 mesh.quads.data(), GL_STATIC_DRAW);
+    shared.refCount = 0;
+    shared.key = mesh.key;
+    sharedBufferIndex.emplace(mesh.key, index);
+  }
+
+  SharedMeshBuffer &shared = sharedBuffers[index];
+  shared.refCount++;
+  sharedBufferUsers++;
+  record.VAO = shared.VAO;
+  record.VBO = shared.VBO;
+  record.sharedBuffer = index + 1;
+}
+
+uint32_t ChunkRegistry::allocate() {
+  uint32_t slot;
+  {
+    std::lock_guard<std::mutex> lock(freeSlotsMutex);
+    if (!freeSlots.empty()) {
+      std::pop_heap(freeSlots.begin(), freeSlots.end(),
+                    std::greater<uint32_t>());
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    } else if (slotEnd.load(std::memory_order_relaxed) < capacity) {
+      slot = slotEnd.load(std::memory_order_relaxed);
+    } else {
+      return INVALID_SLOT;
+    }
+
+    ChunkStateFlags &flags = stateFlags[slot];
+    flags.status = ChunkState::UNINITIALIZED;
+    flags.markedForDeletion = false;
+    flags.active = false;
+    payloads[slot] = nullptr;
+
+    if (slot == slotEnd.load(std::memory_order_relaxed))
+      slotEnd.store(slot + 1, std::memory_order_release);
+  }
+  return slot;
+}
+
+void ChunkRegistry::release(uint32_t slot) {
+  ChunkRenderRecord &record = renderRecords[slot];
+  releaseBuffers(record);
+  record = ChunkRenderRecord{};
+
+  std::lock_guard<std::mutex> lock(freeSlotsMutex);
+  payloads[slot] = nullptr;
+  freeSlots.push_back(slot);
+  std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+}
+
+void ChunkRegistry::releaseUnused(uint32_t slot) {
+  std::lock_guard<std::mutex> lock(freeSlotsMutex);
+  freeSlots.push_back(slot);
+  std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<uint32_t>());
+}
+
+void ChunkRegistry::activate(uint32_t slot, Chunk *chunk) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  glm::ivec3 pos = chunk->chunkPosition;
+  payloads[slot] = chunk;
+  cullPositions[slot] = glm::vec3(pos) * (float)CHUNK_SIZE;
+  renderRecords[slot].packedPosition = Voxel::packChunkData(pos.x, pos.y, pos.z);
+  stateFlags[slot].active.store(true, std::memory_order_release);
+  activeCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ChunkRegistry::deactivate(uint32_t slot) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  if (stateFlags[slot].active.exchange(false, std::memory_order_acq_rel))
+    activeCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ChunkRegistry::uploadMesh(uint32_t slot) {
+  ChunkStateFlags &flags = stateFlags[slot];
+  ChunkRenderRecord &record = renderRecords[slot];
+  Chunk *chunk = payloads[slot];
+
+  // A mesh job holds the lock while it runs and will leave a newer mesh, so
+  // try again next frame rather than wait for it.
+  std::unique_lock<std::mutex> meshLock(chunk->getMeshMutex(),
+                                        std::try_to_lock);
+  if (!meshLock.owns_lock())
+    return;
+
+  // A worker may have queued a newer mesh meanwhile; leave that one alone.
+  ChunkState expected = ChunkState::WAITING_FOR_UPLOAD;
+  if (!flags.status.compare_exchange_strong(expected, ChunkState::UPLOADING))
+    return;
+
+  const ChunkMesh &mesh = *chunk->getMesh();
+  const std::vector<Voxel::PackedVoxel> &meshData = mesh.quads;
+  const uint32_t size = (uint32_t)meshData.size();
+
+  if (!mesh.smoothIndices.empty()) {
+    uploadSmoothMesh(record, mesh);
+  } else if (!mesh.key.isNull() && size != 0) {
+    // A cached mesh: draw from the VBO every chunk holding it shares.
+    bindSharedBuffer(record, mesh);
+  } else {
+    // The chunk's own VBO. Leaving a shared one or a smooth mesh's means
+    // starting a new one, which the capacity check below fills whole.
+    if (record.sharedBuffer != 0 || record.EBO != 0)
+      releaseBuffers(record);
+
+    // Enclosed chunks (e.g. uniform solid ones underground) mesh to nothing
+    // and never need a VAO/VBO.
+    if (size != 0 && record.VAO == 0)
+      createQuadBuffers(record.VAO, record.VBO);
+  }
+
+  // Only the quads the mesh job changed are sent. A mesh that outgrew the
+  // VBO is sent whole into a larger one, with headroom so that a run of
+  // edits adding a few quads each doesn't reallocate every time.
+  if (record.VAO != 0 && record.sharedBuffer == 0 && record.EBO == 0) {
+    glBindBuffer(GL_ARRAY_BUFFER, record.VBO);
+    if (size > record.vboCapacity) {
+      record.vboCapacity = size + size / 4;
+      glBufferData(GL_ARRAY_BUFFER,
+                   record.vboCapacity * sizeof(Voxel::PackedVoxel), nullptr,
+                   GL_DYNAMIC_DRAW);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, size * sizeof(Voxel::PackedVoxel),
+                      meshData.data());
+    } else if (chunk->getMeshDirtyBegin() < chunk->getMeshDirtyEnd()) {
+      uint32_t begin = chunk->getMeshDirtyBegin();
+      glBufferSubData(GL_ARRAY_BUFFER, begin * sizeof(Voxel::PackedVoxel),
+                      (chunk->getMeshDirtyEnd() - begin) *
+                          sizeof(Voxel::PackedVoxel),
+                      meshData.data() + begin);
+    }
+  }
+  if (record.EBO == 0)
+    for (int face = 0; face <= 6; ++face)
+      record.faceOffsets[face] = chunk->getMeshFaceOffset(face);
+
+  if (int64_t editTime = chunk->getMeshEditTime()) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    editLatency.count++;
+    editLatency.totalNs += now - editTime;
+    editLatency.maxNs = std::max(editLatency.maxNs, now - editTime);
+  }
+  // A chunk being edited keeps its mesh, so the next edit is spliced in
+  // rather than meshed from scratch. Cached meshes are kept as well (see
+  // Chunk::releaseMeshData).
+  if (chunk->getMeshEditTime() == 0)
+    chunk->releaseMeshData();
+  chunk->clearMeshDirty();
+
+  expected = ChunkState::UPLOADING;
+  flags.status.compare_exchange_strong(expected, ChunkState::IDLE);
+}
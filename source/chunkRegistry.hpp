@@ -0,0 +1,168 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// What the render loop needs to draw one chunk: 56 bytes. The VBO holds the
+// quads grouped by face (Voxel::VoxelFace order); face f is instances
+// [faceOffsets[f], faceOffsets[f + 1]), so faceOffsets[6] is the total.
+// vboCapacity is the VBO's size in quads, which can run ahead of the mesh.
+// sharedBuffer is 0 when the record owns its VAO/VBO, else 1 + the index of
+// the ChunkRegistry buffer it shares with other chunks.
+// A smooth mesh (see SurfaceNets) instead has its vertices in the VBO, its
+// triangles in the EBO and indexCount != 0; its faceOffsets are all 0.
+// Only the render thread reads or writes these.
+struct ChunkRenderRecord {
+  GLuint VAO;
+  GLuint VBO;
+  Voxel::PackedChunkData packedPosition;
+  uint32_t faceOffsets[7];
+  uint32_t vboCapacity;
+  uint32_t sharedBuffer;
+  GLuint EBO;
+  uint32_t indexCount;
+
+  uint32_t getInstanceCount() const { return faceOffsets[6]; }
+};
+
+// Bit f is set when faces of direction f (Voxel::VoxelFace) in the chunk
+// whose minimum corner is chunkMin can face the camera. A +x face is only
+// ever seen from the +x side of its plane, so once the camera is at or below
+// the chunk's lowest +x plane none of them can be; likewise per direction.
+// From any position at least three of the six bits are clear unless the
+// camera is inside the chunk's slab on some axis.
+inline uint8_t getVisibleFaceMask(const glm::vec3 &cameraPos,
+                                  const glm::vec3 &chunkMin) {
+  const glm::vec3 rel = cameraPos - chunkMin;
+  constexpr float S = (float)CHUNK_SIZE;
+  uint8_t mask = 0;
+  if (rel.z > 0.0f) mask |= 1 << Voxel::FRONT;
+  if (rel.z < S)    mask |= 1 << Voxel::BACK;
+  if (rel.y > 0.0f) mask |= 1 << Voxel::TOP;
+  if (rel.y < S)    mask |= 1 << Voxel::BOTTOM;
+  if (rel.x > 0.0f) mask |= 1 << Voxel::RIGHT;
+  if (rel.x < S)    mask |= 1 << Voxel::LEFT;
+  return mask;
+}
+
+// Structure-of-arrays registry of chunks, indexed by a dense slot.
+//
+// Each array holds one kind of data, so each loop only pulls in the cache
+// lines it uses:
+//   cullPositions  world-space minimum corner (frustum culling);
+//   renderRecords  GL objects and per-face instance ranges (drawing);
+//   stateFlags     the state machine that workers and the render loop share;
+//   payloads       the Chunk itself (voxels, mesh, neighbors).
+// Slots are recycled lowest-free-first, so the live range stays dense, and
+// each slot keeps its address for the chunk's whole lifetime. Workers can
+// therefore hold a reference to their chunk's flags without locking.
+class ChunkRegistry {
+public:
+  static constexpr uint32_t INVALID_SLOT = 0xFFFFFFFFu;
+
+  explicit ChunkRegistry(size_t capacity);
+  ~ChunkRegistry();
+
+  ChunkRegistry(const ChunkRegistry &) = delete;
+  ChunkRegistry &operator=(const ChunkRegistry &) = delete;
+
+  // Reserves a slot for a chunk about to be generated, with its flags reset.
+  // Returns INVALID_SLOT when every slot is taken.
+  uint32_t allocate();
+  // Frees the slot's GL objects and recycles it. The chunk must already be
+  // destroyed. Call it on the render thread once the slot has been drawn.
+  void release(uint32_t slot);
+  // Recycles a slot that was allocated but never activated. It has no GL
+  // objects, so any thread may call it.
+  void releaseUnused(uint32_t slot);
+
+  // Attaches the chunk as the slot's payload and shows it to the render
+  // loop, or hides it again (the chunk itself stays alive).
+  void activate(uint32_t slot, Chunk *chunk);
+  void deactivate(uint32_t slot);
+
+  // Render thread: copies the chunk's finished mesh into the slot's VBO,
+  // creating the GL objects on first use, and moves it to IDLE. Only the
+  // part the last mesh jobs changed is sent. Skipped (and left for the next
+  // frame) while a mesh job holds the chunk.
+  void uploadMesh(uint32_t slot);
+
+  // Time from a setVoxel to the upload of the first mesh that includes it,
+  // over the uploads since the last reset.
+  struct EditLatencyStats {
+    uint64_t count = 0;
+    int64_t totalNs = 0;
+    int64_t maxNs = 0;
+  };
+  const EditLatencyStats &getEditLatency() const { return editLatency; }
+  void resetEditLatency() { editLatency = EditLatencyStats(); }
+
+  // VBOs shared through the MeshCache, and the slots drawing from them.
+  size_t getSharedBufferCount() const { return sharedBufferIndex.size(); }
+  size_t getSharedBufferUsers() const { return sharedBufferUsers; }
+
+  // Slots at or past this index have never been used.
+  uint32_t getSlotEnd() const { return slotEnd.load(std::memory_order_acquire); }
+  size_t getCapacity() const { return capacity; }
+  size_t getActiveCount() const {
+    return activeCount.load(std::memory_order_relaxed);
+  }
+
+  // The render loop reads the arrays under a shared lock; activate() and
+  // deactivate() take it exclusively.
+  std::shared_mutex &getMutex() const { return mutex; }
+
+  const glm::vec3 *getCullPositions() const { return cullPositions.get(); }
+  const ChunkRenderRecord &getRenderRecord(uint32_t slot) const {
+    return renderRecords[slot];
+  }
+  ChunkStateFlags &getState(uint32_t slot) const { return stateFlags[slot]; }
+  Chunk *getChunk(uint32_t slot) const { return payloads[slot]; }
+
+private:
+  // GL objects of one cached mesh, shared by every slot whose chunk holds
+  // that mesh.
+  struct SharedMeshBuffer {
+    GLuint VAO;
+    GLuint VBO;
+    uint32_t refCount;
+    MeshKey key;
+  };
+
+  // Points record at the shared buffer for mesh, uploading it on first use.
+  void bindSharedBuffer(ChunkRenderRecord &record, const ChunkMesh &mesh);
+  // Sends a smooth mesh into the record's own VBO and EBO.
+  void uploadSmoothMesh(ChunkRenderRecord &record, const ChunkMesh &mesh);
+  // Deletes the record's own GL objects, or drops its share.
+  void releaseBuffers(ChunkRenderRecord &record);
+
+  size_t capacity;
+
+  std::unique_ptr<glm::vec3[]> cullPositions;
+  std::unique_ptr<ChunkRenderRecord[]> renderRecords;
+  std::unique_ptr<ChunkStateFlags[]> stateFlags;
+  std::unique_ptr<Chunk *[]> payloads;
+
+  EditLatencyStats editLatency;
+
+  // Render thread only, like the records.
+  std::vector<SharedMeshBuffer> sharedBuffers;
+  std::vector<uint32_t> freeSharedBuffers;
+  std::unordered_map<MeshKey, uint32_t, MeshKeyHash> sharedBufferIndex;
+  size_t sharedBufferUsers = 0;
+
+  std::atomic<uint32_t> slotEnd{0};
+  std::atomic<size_t> activeCount{0};
+  mutable std::shared_mutex mutex;
+
+  // Free slots below slotEnd, kept as a min-heap so reuse fills the lowest
+  // holes first.
+  std::vector<uint32_t> freeSlots;
+  std::mutex freeSlotsMutex;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// Chunk edge length in voxels, fixed at compile time. Build with
+// -DCHUNK_SIZE_BITS=5 for 32^3 chunks; the default 4 gives 16^3.
+#ifndef CHUNK_SIZE_BITS
+#define CHUNK_SIZE_BITS 4
+#endif
+
+#define CHUNK_SIZE (1 << CHUNK_SIZE_BITS)
+
+// 64^3 (6 bits) would need 18 bits of position and 12 of quad size, leaving
+// 2 of the 32-bit vertex's bits for the color, which needs at least 4 (see
+// the layout in voxel.hpp).
+static_assert(CHUNK_SIZE_BITS == 4 || CHUNK_SIZE_BITS == 5,
+              "CHUNK_SIZE_BITS must be 4 (16^3) or 5 (32^3)");
+
+#define CHUNK_WIDTH CHUNK_SIZE
+#define CHUNK_HEIGHT CHUNK_SIZE
+#define CHUNK_DEPTH CHUNK_SIZE
+
+#define CHUNK_VOLUME (CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_DEPTH)
+
+// Smallest unsigned integer with at least `bits` bits.
+template <int bits>
+using ChunkBitsType = typename std::conditional<
+    bits <= 16, uint16_t,
+    typename std::conditional<bits <= 32, uint32_t, uint64_t>::type>::type;
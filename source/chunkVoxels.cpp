@@ -0,0 +1,329 @@
+#include "chunkVoxels.hpp"
+#include <algorithm>
+#include <cstring>
+
+std::atomic<size_t> ChunkVoxels::totalMemoryUsage{0};
+
+ChunkVoxels::ChunkVoxels(uint8_t fillID) : palette(1, fillID), bitsPerVoxel(0) {
+  trackMemory(getMemoryUsage());
+}
+
+ChunkVoxels::ChunkVoxels(const ChunkVoxels &other)
+    : palette(other.palette), bitsPerVoxel(other.bitsPerVoxel) {
+  copyArrays(other);
+  trackMemory(getMemoryUsage());
+}
+
+void ChunkVoxels::copyArrays(const ChunkVoxels &other) {
+  words.reset();
+  occupancy.reset();
+  if (bitsPerVoxel == 0)
+    return;
+
+  int count = wordCount(bitsPerVoxel);
+  words.reset(new uint64_t[count]);
+  std::memcpy(words.get(), other.words.get(), count * sizeof(uint64_t));
+  occupancy.reset(new ChunkColumn[COLUMN_COUNT]);
+  std::memcpy(occupancy.get(), other.occupancy.get(),
+              COLUMN_COUNT * sizeof(ChunkColumn));
+}
+
+ChunkVoxels &ChunkVoxels::operator=(const ChunkVoxels &other) {
+  if (this == &other)
+    return *this;
+
+  size_t before = getMemoryUsage();
+  palette = other.palette;
+  bitsPerVoxel = other.bitsPerVoxel;
+  copyArrays(other);
+  trackMemory((ptrdiff_t)getMemoryUsage() - (ptrdiff_t)before);
+  return *this;
+}
+
+// Moves hand the heap blocks over as-is, so the process total is unchanged;
+// the moved-from storage owns nothing and may only be destroyed or assigned.
+ChunkVoxels::ChunkVoxels(ChunkVoxels &&other) noexcept
+    : palette(std::move(other.palette)), words(std::move(other.words)),
+      occupancy(std::move(other.occupancy)), bitsPerVoxel(other.bitsPerVoxel) {
+  other.palette.clear();
+  other.palette.shrink_to_fit();
+  other.bitsPerVoxel = 0;
+}
+
+ChunkVoxels &ChunkVoxels::operator=(ChunkVoxels &&other) noexcept {
+  if (this == &other)
+    return *this;
+
+  trackMemory(-(ptrdiff_t)getMemoryUsage());
+  palette = std::move(other.palette);
+  words = std::move(other.words);
+  occupancy = std::move(other.occupancy);
+  bitsPerVoxel = other.bitsPerVoxel;
+  other.palette.clear();
+  other.palette.shrink_to_fit();
+  other.bitsPerVoxel = 0;
+  return *this;
+}
+
+ChunkVoxels::~ChunkVoxels() { trackMemory(-(ptrdiff_t)getMemoryUsage()); }
+
+size_t ChunkVoxels::getMemoryUsage() const {
+  size_t bytes = palette.capacity();
+  if (bitsPerVoxel > 0) {
+    bytes += wordCount(bitsPerVoxel) * sizeof(uint64_t);
+    bytes += COLUMN_COUNT * sizeof(ChunkColumn);
+  }
+  return bytes;
+}
+
+bool ChunkVoxels::hasSingleSolidID() const {
+  if (bitsPerVoxel == 8)
+    return false;
+
+  int solidIDs = 0;
+  for (uint8_t id : palette)
+    solidIDs += (id != 0);
+  return solidIDs <= 1;
+}
+
+void ChunkVoxels::trackMemory(ptrdiff_t delta) {
+  if (delta >= 0)
+    totalMemoryUsage.fetch_add((size_t)delta, std::memory_order_relaxed);
+  else
+    totalMemoryUsage.fetch_sub((size_t)-delta, std::memory_order_relaxed);
+}
+
+int ChunkVoxels::findPaletteIndex(uint8_t voxelID) const {
+  for (size_t i = 0; i < palette.size(); ++i) {
+    if (palette[i] == voxelID)
+      return (int)i;
+  }
+  return -1;
+}
+
+void ChunkVoxels::setRaw(int index, uint32_t value) {
+  int bitOffset = index * bitsPerVoxel;
+  uint64_t mask = ((1ull << bitsPerVoxel) - 1) << (bitOffset & 63);
+  uint64_t &word = words[bitOffset >> 6];
+  word = (word & ~mask) | ((uint64_t)value << (bitOffset & 63));
+}
+
+bool ChunkVoxels::prepareValue(uint8_t voxelID, uint32_t &value) {
+  value = voxelID;
+  if (bitsPerVoxel == 8)
+    return true;
+
+  int paletteIndex = findPaletteIndex(voxelID);
+  if (paletteIndex < 0) {
+    if (palette.size() == (1u << bitsPerVoxel))
+      grow();
+
+    if (bitsPerVoxel < 8) {
+      size_t before = getMemoryUsage();
+      palette.push_back(voxelID);
+      trackMemory((ptrdiff_t)getMemoryUsage() - (ptrdiff_t)before);
+      paletteIndex = (int)palette.size() - 1;
+    }
+  }
+
+  // Still uniform: the ID was already the palette's only entry.
+  if (bitsPerVoxel == 0)
+    return false;
+  if (bitsPerVoxel < 8)
+    value = (uint32_t)paletteIndex;
+  return true;
+}
+
+void ChunkVoxels::set(int index, uint8_t voxelID) {
+  uint32_t value;
+  if (!prepareValue(voxelID, value))
+    return;
+
+  setRaw(index, value);
+
+  ChunkColumn bit = ChunkColumn(1) << (index % CHUNK_DEPTH);
+  ChunkColumn &column = occupancy[index / CHUNK_DEPTH];
+  column = (voxelID != 0) ? (column | bit) : (column & ~bit);
+}
+
+void ChunkVoxels::decodeColumn(int x, int y, uint8_t *out) const {
+  if (bitsPerVoxel == 0) {
+    std::memset(out, palette[0], CHUNK_DEPTH);
+    return;
+  }
+
+  // Columns start on a multiple of CHUNK_DEPTH voxels and widths divide 64,
+  // so a column starts word-aligned or sits inside a single word; walk it a
+  // word at a time. At 8 bits every column is word-aligned.
+  int bitOffset = toIndex(x, y, 0) * bitsPerVoxel;
+  const uint64_t *columnWords = &words[bitOffset >> 6];
+  int shift = bitOffset & 63;
+  uint64_t mask = (1ull << bitsPerVoxel) - 1;
+
+  if (bitsPerVoxel == 8) {
+    for (int z = 0; z < CHUNK_DEPTH; ++z)
+      out[z] = (uint8_t)(columnWords[z >> 3] >> ((z & 7) * 8));
+    return;
+  }
+
+  for (int z = 0; z < CHUNK_DEPTH; ++columnWords, shift = 0) {
+    uint64_t word = *columnWords >> shift;
+    for (; shift < 64 && z < CHUNK_DEPTH; shift += bitsPerVoxel, ++z) {
+      out[z] = palette[word & mask];
+      word >>= bitsPerVoxel;
+    }
+  }
+}
+
+// Doubles the bit width (0 -> 1 -> 2 -> 4 -> 8) and repacks every voxel.
+// Going to 8 bits switches to direct storage and frees the palette.
+void ChunkVoxels::grow() {
+  size_t before = getMemoryUsage();
+  int newBits = (bitsPerVoxel == 0) ? 1 : bitsPerVoxel * 2;
+  std::unique_ptr<uint64_t[]> newWords(new uint64_t[wordCount(newBits)]());
+
+  // Leaving uniform storage, every voxel is palette index 0 and the zeroed
+  // words already say so.
+  for (int i = 0; bitsPerVoxel != 0 && i < CHUNK_VOLUME; ++i) {
+    int bitOffset = i * bitsPerVoxel;
+    uint32_t value = (words[bitOffset >> 6] >> (bitOffset & 63)) &
+                     ((1u << bitsPerVoxel) - 1);
+    if (newBits == 8)
+      value = palette[value];
+
+    int newOffset = i * newBits;
+    newWords[newOffset >> 6] |= (uint64_t)value << (newOffset & 63);
+  }
+
+  if (bitsPerVoxel == 0) {
+    ChunkColumn seed = palette[0] != 0 ? (ChunkColumn)~ChunkColumn(0) : 0;
+    occupancy.reset(new ChunkColumn[COLUMN_COUNT]);
+    std::fill(occupancy.get(), occupancy.get() + COLUMN_COUNT, seed);
+  }
+
+  words = std::move(newWords);
+  bitsPerVoxel = (uint8_t)newBits;
+  if (newBits == 8) {
+    palette.clear();
+    palette.shrink_to_fit();
+  }
+  trackMemory((ptrdiff_t)getMemoryUsage() - (ptrdiff_t)before);
+}
+
+void ChunkVoxels::fill(uint8_t voxelID) {
+  size_t before = getMemoryUsage();
+  words.reset();
+  occupancy.reset();
+  bitsPerVoxel = 0;
+  palette.assign(1, voxelID);
+  palette.shrink_to_fit();
+  trackMemory((ptrdiff_t)getMemoryUsage() - (ptrdiff_t)before);
+}
+
+// Spreads the low 64 / bits bits of mask so that bit i fills the whole
+// bits-wide field i of the result.
+static inline uint64_t spreadMask(uint64_t mask, int bits) {
+  switch (bits) {
+  case 1:
+    return mask;
+  case 2:
+    mask &= 0xFFFFFFFFull;
+    mask = (mask | mask << 16) & 0x0000FFFF0000FFFFull;
+    mask = (mask | mask << 8) & 0x00FF00FF00FF00FFull;
+    mask = (mask | mask << 4) & 0x0F0F0F0F0F0F0F0Full;
+    mask = (mask | mask << 2) & 0x3333333333333333ull;
+    mask = (mask | mask << 1) & 0x5555555555555555ull;
+    return mask * 0x3;
+  case 4:
+    mask &= 0xFFFFull;
+    mask = (mask | mask << 24) & 0x000000FF000000FFull;
+    mask = (mask | mask << 12) & 0x000F000F000F000Full;
+    mask = (mask | mask << 6) & 0x0303030303030303ull;
+    mask = (mask | mask << 3) & 0x1111111111111111ull;
+    return mask * 0xF;
+  default:
+    mask &= 0xFFull;
+    mask = (mask | mask << 28) & 0x0000000F0000000Full;
+    mask = (mask | mask << 14) & 0x0003000300030003ull;
+    mask = (mask | mask << 7) & 0x0101010101010101ull;
+    return mask * 0xFF;
+  }
+}
+
+void ChunkVoxels::setColumn(int x, int y, ChunkColumn mask, uint8_t voxelID) {
+  if (mask == 0)
+    return;
+
+  uint32_t value;
+  if (!prepareValue(voxelID, value))
+    return;
+
+  // value repeated into every field of a word; the spread mask picks which
+  // fields take it. Same column walk as decodeColumn().
+  uint64_t pattern = value * (~0ull / ((1ull << bitsPerVoxel) - 1));
+  int bitOffset = toIndex(x, y, 0) * bitsPerVoxel;
+  uint64_t *columnWords = &words[bitOffset >> 6];
+  int shift = bitOffset & 63;
+  int voxelsPerWord = 64 / bitsPerVoxel;
+
+  uint64_t remaining = mask;
+  for (int z = 0; z < CHUNK_DEPTH; z += voxelsPerWord, ++columnWords) {
+    uint64_t fields = spreadMask(remaining, bitsPerVoxel) << shift;
+    *columnWords = (*columnWords & ~fields) | (pattern & fields);
+    remaining = voxelsPerWord < 64 ? remaining >> voxelsPerWord : 0;
+    shift = 0;
+  }
+
+  ChunkColumn &column = occupancy[x * CHUNK_HEIGHT + y];
+  column = (voxelID != 0) ? (column | mask) : (column & ~mask);
+}
+
+void ChunkVoxels::fillColumn(int x, int y, int z0, int z1, uint8_t voxelID) {
+  if (z0 >= z1)
+    return;
+  uint64_t below = (z1 >= 64) ? ~0ull : (1ull << z1) - 1;
+  setColumn(x, y, (ChunkColumn)(below & ~((1ull << z0) - 1)), voxelID);
+}
+
+void ChunkVoxels::fillBox(int x0, int y0, int z0, int x1, int y1, int z1,
+                          uint8_t voxelID) {
+  if (x0 <= 0 && y0 <= 0 && z0 <= 0 && x1 >= CHUNK_WIDTH &&
+      y1 >= CHUNK_HEIGHT && z1 >= CHUNK_DEPTH) {
+    fill(voxelID);
+    return;
+  }
+
+  x0 = std::max(x0, 0), y0 = std::max(y0, 0), z0 = std::max(z0, 0);
+  x1 = std::min(x1, CHUNK_WIDTH), y1 = std::min(y1, CHUNK_HEIGHT);
+  z1 = std::min(z1, CHUNK_DEPTH);
+  for (int x = x0; x < x1; ++x) {
+    for (int y = y0; y < y1; ++y)
+      fillColumn(x, y, z0, z1, voxelID);
+  }
+}
+
+void ChunkVoxels::fillFromHeightmap(const int *heights, int baseY,
+                                    uint8_t voxelID) {
+  for (int x = 0; x < CHUNK_WIDTH; ++x) {
+    const int *row = &heights[x * CHUNK_DEPTH];
+    int maxHeight = *std::max_element(row, row + CHUNK_DEPTH);
+    int top = std::min(maxHeight - baseY, CHUNK_HEIGHT);
+
+    for (int y = 0; y < top; ++y) {
+      ChunkColumn mask = 0;
+      for (int z = 0; z < CHUNK_DEPTH; ++z)
+        mask |= (ChunkColumn)(baseY + y < row[z]) << z;
+      setColumn(x, y, mask, voxelID);
+    }
+  }
+}
+
+int ChunkVoxels::countSolid() const {
+  if (bitsPerVoxel == 0)
+    return palette[0] != 0 ? CHUNK_VOLUME : 0;
+
+  int count = 0;
+  for (int i = 0; i < COLUMN_COUNT; ++i)
+    count += __builtin_popcountll(occupancy[i]);
+  return count;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chunkSize.hpp"
+
+// One occupancy column: bit z is set when voxel (x, y, z) is solid.
+typedef ChunkBitsType<CHUNK_DEPTH> ChunkColumn;
+static_assert(sizeof(ChunkColumn) * 8 == CHUNK_DEPTH,
+              "ChunkColumn must hold exactly one bit per voxel along z");
+
+// Palette-compressed voxel payload for one chunk.
+//
+// Voxels are stored as indices into a small palette of voxel IDs, packed at
+// 0, 1, 2, 4 or 8 bits per voxel. A fresh chunk is 0 bits (a single palette
+// entry, no voxel array at all) and the width grows on demand in set() when a
+// new ID doesn't fit the current palette. At 8 bits the palette is dropped and
+// the array holds voxel IDs directly.
+//
+// Bit widths always divide 64, so a voxel never straddles two words.
+//
+// Alongside the palette, non-uniform storage keeps an occupancy bitset with
+// one ChunkColumn per (x, y), so the mesher can find faces with bit ops
+// instead of decoding palette indices voxel by voxel.
+class ChunkVoxels {
+public:
+  ChunkVoxels(uint8_t fillID = 0);
+  ChunkVoxels(const ChunkVoxels &other);
+  ChunkVoxels &operator=(const ChunkVoxels &other);
+  ChunkVoxels(ChunkVoxels &&other) noexcept;
+  ChunkVoxels &operator=(ChunkVoxels &&other) noexcept;
+  ~ChunkVoxels();
+
+  static inline int toIndex(int x, int y, int z) {
+    return (x * CHUNK_HEIGHT + y) * CHUNK_DEPTH + z;
+  }
+
+  inline uint8_t get(int index) const {
+    if (bitsPerVoxel == 0)
+      return palette[0];
+
+    int bitOffset = index * bitsPerVoxel;
+    uint64_t word = words[bitOffset >> 6];
+    uint8_t value = (word >> (bitOffset & 63)) & ((1u << bitsPerVoxel) - 1);
+    return bitsPerVoxel == 8 ? value : palette[value];
+  }
+
+  void set(int index, uint8_t voxelID);
+
+  // Decodes the CHUNK_DEPTH voxels of column (x, y) into out.
+  void decodeColumn(int x, int y, uint8_t *out) const;
+
+  // Resets every voxel to voxelID and releases the packed array.
+  void fill(uint8_t voxelID);
+
+  // Bulk writes. These touch the packed words and the occupancy bitset a
+  // word at a time, instead of one set() (palette lookup, read-modify-write)
+  // per voxel.
+  //
+  // setColumn: voxelID at every z whose bit is set in mask, column (x, y).
+  void setColumn(int x, int y, ChunkColumn mask, uint8_t voxelID);
+  // fillColumn: voxelID for z in [z0, z1) of column (x, y).
+  void fillColumn(int x, int y, int z0, int z1, uint8_t voxelID);
+  // fillBox: voxelID over the half-open box [x0, x1) x [y0, y1) x [z0, z1).
+  void fillBox(int x0, int y0, int z0, int x1, int y1, int z1,
+               uint8_t voxelID);
+  // fillFromHeightmap: voxelID wherever baseY + y < heights[x * CHUNK_DEPTH +
+  // z]; voxels above the surface are left as they are.
+  void fillFromHeightmap(const int *heights, int baseY, uint8_t voxelID);
+
+  // Number of non-empty voxels, from the occupancy bitset.
+  int countSolid() const;
+
+  // A uniform storage holds one ID for the whole chunk and no voxel array.
+  bool isUniform() const { return bitsPerVoxel == 0; }
+  uint8_t getUniformID() const { return palette[0]; }
+
+  // Occupancy column for (x, y); uniform storage has no bitset and answers
+  // all-solid or all-empty from its single ID (0 is Voxel::EMPTY).
+  inline ChunkColumn getColumn(int x, int y) const {
+    if (bitsPerVoxel == 0)
+      return palette[0] != 0 ? (ChunkColumn)~ChunkColumn(0) : ChunkColumn(0);
+    return occupancy[x * CHUNK_HEIGHT + y];
+  }
+
+  // True when at most one non-empty ID can appear, so any two solid voxels
+  // are guaranteed to match without decoding them.
+  bool hasSingleSolidID() const;
+
+  int getBitsPerVoxel() const { return bitsPerVoxel; }
+  size_t getPaletteSize() const { return palette.size(); }
+
+  // Heap bytes owned by this storage (packed words + occupancy + palette).
+  size_t getMemoryUsage() const;
+
+  // Heap bytes owned by every live ChunkVoxels in the process.
+  static size_t getTotalMemoryUsage() {
+    return totalMemoryUsage.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr int wordCount(int bits) {
+    return (CHUNK_VOLUME * bits + 63) / 64;
+  }
+
+  int findPaletteIndex(uint8_t voxelID) const;
+  // Grows the palette or bit width as needed to store voxelID and returns
+  // the raw value to write. Returns false if the storage is still uniform
+  // in voxelID, so there is nothing to write.
+  bool prepareValue(uint8_t voxelID, uint32_t &value);
+  static constexpr int COLUMN_COUNT = CHUNK_WIDTH * CHUNK_HEIGHT;
+
+  void setRaw(int index, uint32_t value);
+  void copyArrays(const ChunkVoxels &other);
+  void grow();
+  void trackMemory(ptrdiff_t delta);
+
+  std::vector<uint8_t> palette;
+  std::unique_ptr<uint64_t[]> words;
+  std::unique_ptr<ChunkColumn[]> occupancy;
+  uint8_t bitsPerVoxel;
+
+  static std::atomic<size_t> totalMemoryUsage;
+};
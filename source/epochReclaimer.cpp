@@ -0,0 +1,88 @@
+#include "epochReclaimer.hpp"
+#include <utility>
+
+EpochReclaimer::Guard::Guard(const Guard &other)
+    : owner(other.owner), epoch(other.epoch) {
+  // other holds this epoch, so it is still current or the one before.
+  if (owner != nullptr)
+    owner->guards[epoch % 3].fetch_add(1);
+}
+
+EpochReclaimer::Guard::Guard(Guard &&other) noexcept
+    : owner(other.owner), epoch(other.epoch) {
+  other.owner = nullptr;
+}
+
+EpochReclaimer::Guard &
+EpochReclaimer::Guard::operator=(Guard other) noexcept {
+  std::swap(owner, other.owner);
+  std::swap(epoch, other.epoch);
+  return *this;
+}
+
+void EpochReclaimer::Guard::release() {
+  if (owner == nullptr)
+    return;
+  owner->guards[epoch % 3].fetch_sub(1);
+  owner = nullptr;
+}
+
+// The count goes up before the epoch is checked again: if it is unchanged,
+// no advance can have missed this guard.
+EpochReclaimer::Guard EpochReclaimer::pin() {
+  while (true) {
+    uint64_t e = epoch.load();
+    guards[e % 3].fetch_add(1);
+    if (epoch.load() == e)
+      return Guard(this, e);
+    guards[e % 3].fetch_sub(1);
+  }
+}
+
+void EpochReclaimer::retire(std::function<void()> free) {
+  std::lock_guard<std::mutex> lock(retiredMutex);
+  retired.push_back({epoch.load(), std::move(free)});
+}
+
+size_t EpochReclaimer::collect() {
+  // Two advances free everything retired before the call, if the guards
+  // allow.
+  for (int i = 0; i < 2; ++i) {
+    uint64_t e = epoch.load();
+    if (guards[(e + 2) % 3].load() != 0)
+      break;
+    if (!epoch.compare_exchange_strong(e, e + 1))
+      break;
+  }
+
+  const uint64_t now = epoch.load();
+  std::vector<Retired> ready;
+  {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    auto end = retired.begin();
+    while (end != retired.end() && end->epoch + 2 <= now)
+      ++end;
+    ready.assign(std::make_move_iterator(retired.begin()),
+                 std::make_move_iterator(end));
+    retired.erase(retired.begin(), end);
+  }
+  for (Retired &r : ready)
+    r.free();
+  return ready.size();
+}
+
+size_t EpochReclaimer::collectAll() {
+  std::vector<Retired> ready;
+  {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    ready.swap(retired);
+  }
+  for (Retired &r : ready)
+    r.free();
+  return ready.size();
+}
+
+size_t EpochReclaimer::getRetiredCount() const {
+  std::lock_guard<std::mutex> lock(retiredMutex);
+  return retired.size();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation: frees objects once no thread can still be
+// reading them, without the readers taking a lock.
+//
+// A reader pins the current epoch (pin()) for as long as it uses pointers
+// it reached through shared structures. A writer first unlinks an object,
+// so no new reader can reach it, then retires it with the function that
+// frees it. The epoch only advances once no guard is left on the epoch
+// before the current one. By the time it is two past an object's
+// retirement, every reader that might have seen the object has dropped its
+// guard, and collect() frees it.
+//
+// Copying a Guard pins the same epoch again, on any thread: a task handed
+// to a thread pool takes a copy, and whatever its creator could reach
+// stays allocated until the task is done.
+class EpochReclaimer {
+public:
+  class Guard {
+  public:
+    Guard() = default;
+    Guard(const Guard &other);
+    Guard(Guard &&other) noexcept;
+    Guard &operator=(Guard other) noexcept;
+    ~Guard() { release(); }
+
+    void release();
+
+  private:
+    friend class EpochReclaimer;
+    Guard(EpochReclaimer *owner, uint64_t epoch)
+        : owner(owner), epoch(epoch) {}
+
+    EpochReclaimer *owner = nullptr;
+    uint64_t epoch = 0;
+  };
+
+  EpochReclaimer() = default;
+  // Frees whatever is still retired: no reader may be left.
+  ~EpochReclaimer() { collectAll(); }
+  EpochReclaimer(const EpochReclaimer &) = delete;
+  EpochReclaimer &operator=(const EpochReclaimer &) = delete;
+
+  Guard pin();
+  // free runs on the thread calling collect(), once no guard taken before
+  // this call is left.
+  void retire(std::function<void()> free);
+  // Advances the epoch as far as the guards allow and frees what that made
+  // safe. Returns the number of objects freed.
+  size_t collect();
+  // Frees everything retired, readers or not; for when every thread that
+  // could read has stopped.
+  size_t collectAll();
+
+  uint64_t getEpoch() const { return epoch.load(); }
+  size_t getRetiredCount() const;
+
+private:
+  struct Retired {
+    uint64_t epoch;
+    std::function<void()> free;
+  };
+
+  std::atomic<uint64_t> epoch{0};
+  // Guards by epoch % 3. Only the current epoch and the one before it hold
+  // any, apart from a pin() that lost a race with an advance and is about
+  // to back out.
+  std::atomic<uint32_t> guards[3]{};
+  mutable std::mutex retiredMutex;
+  // Oldest first.
+  std::vector<Retired> retired;
+};
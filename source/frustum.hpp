@@ -3,6 +3,8 @@
 #include <glm/glm.hpp>
 #include <array>
 
+#include "chunkSize.hpp"
+
 // Raw (unnormalized) plane — only the sign of the normal matters for p-vertex
 // selection, and the dot-product test is sign-equivalent without normalization.
 // Skipping 6 sqrts per frame and keeping values in their natural scale.
@@ -31,8 +33,8 @@ public:
     std::array<Plane, 6> planes;
 
     // Precomputed per-plane: the offset added to minPoint to get the p-vertex
-    // for an AABB with a fixed size of 16. Computed once in update().
-    // pVertexOffset[i] = dot(max(normal, 0), vec3(16)) per component.
+    // for an AABB with a fixed size of CHUNK_SIZE. Computed once in update().
+    // pVertexOffset[i] = dot(max(normal, 0), vec3(CHUNK_SIZE)) per component.
     // For a cube chunk of side S: p-vertex dot = dot(n, min) + dot(max(n,0), vec3(S))
     float pVertexDot[6]; // = nx*(nx>0)*S + ny*(ny>0)*S + nz*(nz>0)*S, the fixed addend
 
@@ -74,10 +76,10 @@ public:
         planes[FAR].distance   =  m[3][3] - m[3][2];
 
         // Precompute the fixed chunk-size addend for isChunkVisible.
-        // For each plane: pVertexDot = sum of (normal[i] > 0 ? 16 : 0)
+        // For each plane: pVertexDot = sum of (normal[i] > 0 ? CHUNK_SIZE : 0)
         // This is the part of dot(p-vertex, normal) that doesn't depend on
         // the chunk's world position, so we only pay for it once per frame.
-        constexpr float S = 16.0f;
+        constexpr float S = (float)CHUNK_SIZE;
         for (int i = 0; i < 6; ++i) {
             const glm::vec3& n = planes[i].normal;
             pVertexMask[i] = glm::vec3(
@@ -108,7 +110,7 @@ public:
         return true;
     }
 
-    // Fast path for axis-aligned cubic chunks of fixed size 16.
+    // Fast path for axis-aligned cubic chunks of the compile-time CHUNK_SIZE.
     //
     // The p-vertex dot product splits into two parts:
     //   dot(n, p-vertex) = dot(n, minPoint) + pVertexDot[i]
@@ -116,7 +118,7 @@ public:
     // pVertexDot[i] was precomputed in update() and doesn't change per chunk,
     // so each plane test costs: 3 muls + 2 adds + 1 compare.
     // Plane order: NEAR, FAR, LEFT, RIGHT, TOP, BOTTOM — most likely to cull first.
-    inline bool isChunkVisible(const glm::vec3& minPoint, float /*chunkSize*/ = 16.0f) const {
+    inline bool isChunkVisible(const glm::vec3& minPoint, float /*chunkSize*/ = (float)CHUNK_SIZE) const {
         // NEAR
         {
             const Plane& p = planes[NEAR];
@@ -8,6 +8,7 @@
 #include "camera.hpp"
 #include "chunk.hpp"
 #include "frustum.hpp"
+#include "meshKernels.hpp"
 #include "shader.hpp"
 #include "threadPool.hpp"
 #include "voxel.hpp"
@@ -32,6 +33,14 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void processInput(GLFWwindow *window);
 
+// A chunk that passed culling, with what drawing needs from the registry's
+// arrays copied out while their lock was held.
+struct VisibleChunk {
+  uint32_t slot;
+  Chunk *chunk;
+  glm::vec3 cullPosition;
+};
+
 int main() {
   // Initialize GLFW
   glfwInit();
@@ -60,12 +69,23 @@ int main() {
     return -1;
   }
 
+  // Terminates GLFW once everything declared after it is destroyed: the
+  // chunk registry deletes its GL objects in its destructor.
+  struct GlfwTerminator {
+    ~GlfwTerminator() { glfwTerminate(); }
+  } glfwTerminator;
+
   // Initialize systems
   ThreadPool loadingPool(4);
   ThreadPool updatePool(4);
-  WorldManager worldManager(32);
+  // Render distance is given in chunks; keep the view at 512 voxels whatever
+  // CHUNK_SIZE the build uses.
+  WorldManager worldManager(512 / CHUNK_SIZE);
 
-  Shader baseShader("source/base.vs", "source/base.fs");
+  Shader baseShader("source/base.vs", "source/base.fs",
+                    Voxel::vertexLayoutDefines());
+  Shader smoothShader("source/smooth.vs", "source/smooth.fs",
+                      Voxel::smoothVertexLayoutDefines());
 
   // OpenGL state
   glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -78,10 +98,14 @@ int main() {
   Frustum frustum;
 
   std::cout << "Window opened!" << std::endl;
+  std::cout << "Mesh kernel: "
+            << MeshKernels::getIsaName(MeshKernels::getActiveIsa())
+            << std::endl;
   std::cout << "Controls:" << std::endl;
   std::cout << "  WASD - Move horizontally" << std::endl;
   std::cout << "  QE - Move up/down" << std::endl;
   std::cout << "  TAB - Toggle wireframe" << std::endl;
+  std::cout << "  M - Toggle smooth terrain" << std::endl;
   std::cout << "  ESC - Exit" << std::endl;
 
   // Start world management thread
@@ -92,8 +116,21 @@ int main() {
   int chunksRendered = 0;
   size_t totalVertices = 0;
 
-  // Reuse this allocation across frames to avoid per-frame heap churn.
-  std::vector<Chunk *> visibleChunks;
+  size_t culledVertices = 0;
+  size_t smoothTriangles = 0;
+
+  // Reuse these allocations across frames to avoid per-frame heap churn.
+  std::vector<VisibleChunk> visibleChunks;
+  std::vector<uint32_t> smoothSlots;
+
+  // Set once per face draw, so look them up once.
+  const GLint instanceDataLoc =
+      glGetUniformLocation(baseShader.ID, "instanceData");
+  const GLint faceLoc = glGetUniformLocation(baseShader.ID, "face");
+  const GLint smoothInstanceDataLoc =
+      glGetUniformLocation(smoothShader.ID, "instanceData");
+
+  bool smoothKeyWasPressed = false;
 
   // Main render loop
   while (!glfwWindowShouldClose(window)) {
@@ -103,6 +140,16 @@ int main() {
 
     processInput(window);
 
+    // Toggle smooth terrain; it needs the world, so it lives here rather
+    // than in processInput.
+    int smoothKeyState = glfwGetKey(window, GLFW_KEY_M);
+    if (smoothKeyState == GLFW_PRESS && !smoothKeyWasPressed) {
+      worldManager.setSmoothTerrain(!worldManager.isSmoothTerrain());
+      smoothKeyWasPressed = true;
+    }
+    if (smoothKeyState == GLFW_RELEASE)
+      smoothKeyWasPressed = false;
+
     // Clear screen
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -112,13 +159,6 @@ int main() {
     glm::mat4 projection = camera.getProjectionMatrix(
         (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
 
-    uint8_t visibleQuadFlag = 0;
-
-    for (size_t f = 0; f < 6; ++f) {
-      float dot = glm::dot(camera.getFront(), Voxel::FaceNormals[f]);
-      if (dot < 0.0f) visibleQuadFlag |= (1 << f);
-    }
-
     // Update frustum (also precomputes pVertexDot for isChunkVisible)
     glm::mat4 projectionView = projection * view;
     frustum.update(projectionView);
@@ -129,58 +169,106 @@ int main() {
 
     chunksRendered = 0;
     totalVertices = 0;
+    culledVertices = 0;
+    smoothTriangles = 0;
+    smoothSlots.clear();
 
     baseShader.use();
     baseShader.setMat4("projection", projection);
     baseShader.setMat4("view", view);
 
     // --- Frustum culling ---
-    // We iterate activeChunkWorldPos — a flat array of vec3s with no pointer
-    // chasing — and only dereference the Chunk* for chunks that pass the test.
-    // markedForDeletion is checked after the frustum test so geometry rejects
-    // most chunks before we pay for the atomic load.
+    // Culling reads only the registry's packed cull positions; the flags of
+    // the chunks that pass are checked afterwards, and drawing reads only
+    // their render records and what was copied out here. A Chunk is touched
+    // just to queue or upload a mesh.
+    ChunkRegistry &registry = worldManager.getChunkRegistry();
+    // Chunks found active below stay allocated until the end of the frame.
+    EpochReclaimer::Guard pinned = worldManager.getReclaimer().pin();
     visibleChunks.clear();
     auto startCull = std::chrono::high_resolution_clock::now();
     {
-      std::shared_lock<std::shared_mutex> lock(worldManager.getActiveChunksMutex());
-      const auto &chunks   = worldManager.getActiveChunks();
-      const auto &worldPos = worldManager.getActiveChunkWorldPos();
-      const size_t count   = chunks.size();
-
-      for (size_t i = 0; i < count; ++i) {
-        // Hot path: only touches the flat float array — no Chunk* dereference.
-        if (!frustum.isChunkVisible(worldPos[i]))
+      std::shared_lock<std::shared_mutex> lock(registry.getMutex());
+      const glm::vec3 *cullPositions = registry.getCullPositions();
+      const uint32_t slotEnd = registry.getSlotEnd();
+
+      for (uint32_t slot = 0; slot < slotEnd; ++slot) {
+        if (!frustum.isChunkVisible(cullPositions[slot]))
           continue;
 
-        // Cold path: chunk passed frustum, now check if it's being deleted.
-        Chunk *chunk = chunks[i];
-        if (chunk->markedForDeletion.load(std::memory_order_acquire))
+        const ChunkStateFlags &flags = registry.getState(slot);
+        if (!flags.active.load(std::memory_order_acquire) ||
+            flags.markedForDeletion.load(std::memory_order_acquire))
           continue;
 
-        visibleChunks.push_back(chunk);
+        visibleChunks.push_back(
+            {slot, registry.getChunk(slot), cullPositions[slot]});
       }
     }
     auto endCull = std::chrono::high_resolution_clock::now();
     float timeCull = std::chrono::duration<float, std::milli>(endCull - startCull).count();
 
     auto start = std::chrono::high_resolution_clock::now();
-    for (Chunk *chunk : visibleChunks) {
-      if (!chunk->markedForDeletion.load(std::memory_order_acquire) &&
-          chunk->status == ChunkState::WAITING_FOR_MESH_UPDATE) {
-          worldManager.queueMeshUpdate(chunk);
-          continue;
+    for (const VisibleChunk &visible : visibleChunks) {
+      const uint32_t slot = visible.slot;
+      ChunkState status = registry.getState(slot).status;
+      if (status == ChunkState::WAITING_FOR_MESH_UPDATE) {
+        worldManager.queueMeshUpdate(visible.chunk, pinned);
+      } else if (status == ChunkState::WAITING_FOR_UPLOAD) {
+        registry.uploadMesh(slot);
       }
 
-      size_t vertex_count = chunk->getVertexCount();
-      if (vertex_count == 0) continue;
-
-      glm::ivec3 cp = chunk->chunkPosition;
-      baseShader.setUInt("instanceData", Voxel::packChunkData(cp.x, cp.y, cp.z));
-
-      chunk->bindAndDraw();
-      totalVertices += vertex_count;
+      // Keeps drawing the last uploaded mesh while a new one is built.
+      const ChunkRenderRecord &record = registry.getRenderRecord(slot);
+      // Smooth meshes are drawn after the quads, with their own shader.
+      if (record.indexCount != 0) {
+        smoothSlots.push_back(slot);
+        continue;
+      }
+      if (record.getInstanceCount() == 0) continue;
+
+      // Chunk-level backface culling: skip every face direction that points
+      // away from the camera for the whole chunk. GL 4.1 has no base-instance
+      // draw, so each face's range is selected by moving the attribute's
+      // start instead.
+      const uint8_t visibleFaces =
+          getVisibleFaceMask(cameraPos, visible.cullPosition);
+      glUniform1ui(instanceDataLoc, record.packedPosition);
+      glBindVertexArray(record.VAO);
+      glBindBuffer(GL_ARRAY_BUFFER, record.VBO);
+      for (int f = 0; f < 6; ++f) {
+        const uint32_t first = record.faceOffsets[f];
+        const uint32_t count = record.faceOffsets[f + 1] - first;
+        if (count == 0) continue;
+        if (!(visibleFaces & (1 << f))) {
+          culledVertices += count;
+          continue;
+        }
+
+        glVertexAttribIPointer(
+            0, 1, GL_UNSIGNED_INT, sizeof(Voxel::PackedVoxel),
+            (void *)(uintptr_t)(first * sizeof(Voxel::PackedVoxel)));
+        glUniform1ui(faceLoc, f);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                              static_cast<GLsizei>(count));
+        totalVertices += count;
+      }
       chunksRendered++;
     }
+    if (!smoothSlots.empty()) {
+      smoothShader.use();
+      smoothShader.setMat4("projection", projection);
+      smoothShader.setMat4("view", view);
+      for (uint32_t slot : smoothSlots) {
+        const ChunkRenderRecord &record = registry.getRenderRecord(slot);
+        glUniform1ui(smoothInstanceDataLoc, record.packedPosition);
+        glBindVertexArray(record.VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(record.indexCount),
+                       GL_UNSIGNED_SHORT, (void *)0);
+        smoothTriangles += record.indexCount / 3;
+        chunksRendered++;
+      }
+    }
     auto end = std::chrono::high_resolution_clock::now();
     float time = std::chrono::duration<float, std::milli>(end - start).count();
 
@@ -191,12 +279,44 @@ int main() {
       std::cout << "FPS: " << fps
                 << " | Chunks loaded: " << worldManager.getLoadedChunkCount()
                 << " | Rendered: " << chunksRendered
-                << " | Vertices: " << totalVertices << std::endl;
+                << " | Vertices: " << totalVertices
+                << " | Backface-culled: " << culledVertices
+                << " | Smooth triangles: " << smoothTriangles << std::endl;
+      std::cout << "Voxel storage: "
+                << ChunkVoxels::getTotalMemoryUsage() / 1024 << " KB"
+                << " | Far-field bricks: "
+                << BrickMap::getTotalMemoryUsage() / 1024 << " KB"
+                << std::endl;
+      const ChunkPool &pool = worldManager.getChunkPool();
+      std::cout << "Chunk pool: " << pool.getInUse() << "/"
+                << pool.getCapacity() << " slots (high-water "
+                << pool.getHighWaterMark() << ", overflow "
+                << pool.getOverflowCount()
+                << (pool.isUsingHugePages() ? ", huge pages" : "") << ")"
+                << std::endl;
+      const ChunkRegistry::EditLatencyStats &editLatency =
+          registry.getEditLatency();
+      if (editLatency.count != 0) {
+        std::cout << "Edit to upload: avg "
+                  << editLatency.totalNs / editLatency.count / 1e6
+                  << " ms, max " << editLatency.maxNs / 1e6 << " ms ("
+                  << editLatency.count << " meshes)" << std::endl;
+        registry.resetEditLatency();
+      }
+      const MeshCache &meshCache = worldManager.getMeshCache();
+      if (size_t lookups = meshCache.getLookupCount()) {
+        std::cout << "Mesh cache: " << meshCache.getHitCount() << "/"
+                  << lookups << " hits ("
+                  << 100.0 * meshCache.getHitCount() / lookups << "%), "
+                  << meshCache.getEntryCount() << " meshes, "
+                  << registry.getSharedBufferCount() << " shared VBOs for "
+                  << registry.getSharedBufferUsers() << " chunks" << std::endl;
+      }
       std::cout << "Frame Time spent rendering: " << time * fps << std::endl;
       std::cout << "Frame Time spent culling  : " << timeCull * fps << std::endl;
-      std::cout << "Visible Normals: " << (int)visibleQuadFlag << std::endl;
     }
 
+    pinned.release();
     worldManager.cleanUpDeletedChunks();
 
     glfwSwapBuffers(window);
@@ -204,7 +324,6 @@ int main() {
   }
 
   worldManager.stop();
-  glfwTerminate();
   return 0;
 }
 
@@ -0,0 +1,74 @@
+#include "meshCache.hpp"
+#include <algorithm>
+#include <cstring>
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// Two independent multiply-rotate lanes over the padded voxel array, which
+// holds everything the mesh depends on (occupancy is derived from it), plus
+// the level of detail.
+MeshKey MeshCache::computeKey(const ChunkMeshInput &input) {
+  static_assert(sizeof(input.voxels) % sizeof(uint64_t) == 0,
+                "the padded voxel array must be a whole number of words");
+  constexpr size_t WORDS = sizeof(input.voxels) / sizeof(uint64_t);
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(input.voxels);
+
+  uint64_t a = 0x9e3779b97f4a7c15ull ^ (uint64_t)input.lodLevel;
+  uint64_t b = 0xc2b2ae3d27d4eb4full;
+  for (size_t i = 0; i < WORDS; ++i) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(word));
+    a = rotl64(a ^ word, 27) * 0x9fb21c651e98df25ull;
+    b = rotl64(b + word, 31) * 0xff51afd7ed558ccdull;
+  }
+
+  MeshKey key;
+  key.lo = splitmix64(a ^ WORDS);
+  key.hi = splitmix64(b + key.lo);
+  // The null key means "not cached".
+  if (key.isNull())
+    key.lo = 1;
+  return key;
+}
+
+ChunkMeshPtr MeshCache::find(const MeshKey &key) {
+  lookups.fetch_add(1, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(key);
+  if (it == entries.end())
+    return nullptr;
+  ChunkMeshPtr mesh = it->second.lock();
+  if (mesh)
+    hits.fetch_add(1, std::memory_order_relaxed);
+  return mesh;
+}
+
+ChunkMeshPtr MeshCache::insert(ChunkMeshPtr mesh) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::weak_ptr<const ChunkMesh> &entry = entries[mesh->key];
+  if (ChunkMeshPtr existing = entry.lock())
+    return existing;
+  entry = mesh;
+
+  if (entries.size() >= pruneThreshold)
+    pruneLocked();
+  return mesh;
+}
+
+size_t MeshCache::getEntryCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size();
+}
+
+void MeshCache::pruneLocked() {
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->second.expired())
+      it = entries.erase(it);
+    else
+      ++it;
+  }
+  pruneThreshold = std::max<size_t>(1024, entries.size() * 2);
+}
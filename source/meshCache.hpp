@@ -0,0 +1,58 @@
+#pragma once
+
+#include "chunk.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// Content-keyed cache of finished chunk meshes.
+//
+// A mesh depends only on its ChunkMeshInput: the chunk's voxels, its
+// neighbors' border layers and the level of detail. Procedural terrain
+// repeats that input exactly in places (identical columns, plateaus, sealed
+// chunks), so full remeshes hash the input and reuse any live mesh built
+// from the same one. ChunkRegistry then also shares a single VBO between the
+// chunks holding it.
+//
+// Entries are weak: a mesh stays cached while some chunk still uses it, which
+// is why chunks don't release a cached mesh after upload. Keys
+// are 128 bits and trusted without comparing inputs.
+class MeshCache {
+public:
+  MeshCache() = default;
+  MeshCache(const MeshCache &) = delete;
+  MeshCache &operator=(const MeshCache &) = delete;
+
+  // Never the null key.
+  static MeshKey computeKey(const ChunkMeshInput &input);
+
+  // The live mesh built from key's input, or null. Counts as a lookup.
+  ChunkMeshPtr find(const MeshKey &key);
+  // Adds mesh (its key set) and returns the mesh to use: mesh itself, or
+  // an equal one another thread inserted first.
+  ChunkMeshPtr insert(ChunkMeshPtr mesh);
+
+  uint64_t getLookupCount() const {
+    return lookups.load(std::memory_order_relaxed);
+  }
+  uint64_t getHitCount() const { return hits.load(std::memory_order_relaxed); }
+  // Entries, including ones whose mesh has since been dropped and not yet
+  // pruned.
+  size_t getEntryCount() const;
+
+private:
+  // Drops expired entries. Called with mutex held.
+  void pruneLocked();
+
+  std::unordered_map<MeshKey, std::weak_ptr<const ChunkMesh>, MeshKeyHash>
+      entries;
+  // insert() prunes once entries reaches this size, then sets it to twice
+  // the live count, so pruning stays amortized O(1) per insert.
+  size_t pruneThreshold = 1024;
+  mutable std::mutex mutex;
+
+  std::atomic<uint64_t> lookups{0};
+  std::atomic<uint64_t> hits{0};
+};
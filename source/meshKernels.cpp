@@ -0,0 +1,360 @@
+#include "meshKernels.hpp"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MESH_KERNELS_X86 1
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// On the padded columns x and y faces are a single AND-NOT between adjacent
+// columns, with no chunk-bound cases. Plain loops: each kernel inlines them
+// and the compiler vectorizes them for that kernel's target.
+__attribute__((always_inline)) static inline void buildFaceMasksXY(
+    const PaddedColumn columns[PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE], int d,
+    int direction, ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH]) {
+  const PaddedColumn interior = ((PaddedColumn(1) << CHUNK_DEPTH) - 1) << 1;
+
+  if (d == 0) {
+    // Slice x, rows y, bits z.
+    for (int x = 0; x < CHUNK_WIDTH; ++x) {
+      for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+        PaddedColumn faces =
+            columns[x + 1][y + 1] & ~columns[x + 1 + direction][y + 1];
+        faceMasks[x][y] = (ChunkColumn)((faces & interior) >> 1);
+      }
+    }
+  } else {
+    // Slice y, rows x, bits z.
+    for (int x = 0; x < CHUNK_WIDTH; ++x) {
+      for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+        PaddedColumn faces =
+            columns[x + 1][y + 1] & ~columns[x + 1][y + 1 + direction];
+        faceMasks[y][x] = (ChunkColumn)((faces & interior) >> 1);
+      }
+    }
+  }
+}
+
+static void buildFaceMasksScalar(
+    const PaddedColumn columns[PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE], int d,
+    int direction, ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH]) {
+  if (d < 2) {
+    buildFaceMasksXY(columns, d, direction, faceMasks);
+    return;
+  }
+
+  // Slice z, rows x, bits y: the columns run along z, so compute faces per
+  // column with a shift and scatter the (sparse) set bits into the slices.
+  const PaddedColumn interior = ((PaddedColumn(1) << CHUNK_DEPTH) - 1) << 1;
+  std::memset(faceMasks, 0, sizeof(ChunkColumn) * CHUNK_DEPTH * CHUNK_DEPTH);
+  for (int x = 0; x < CHUNK_WIDTH; ++x) {
+    for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+      PaddedColumn column = columns[x + 1][y + 1];
+      PaddedColumn covered = (direction > 0) ? (column >> 1) : (column << 1);
+      PaddedColumn faces = (column & ~covered & interior) >> 1;
+      while (faces) {
+        int z = __builtin_ctzll(faces);
+        faceMasks[z][x] |= ChunkColumn(1) << y;
+        faces &= faces - 1;
+      }
+    }
+  }
+}
+
+#ifdef MESH_KERNELS_X86
+
+// z faces are where the scalar kernel falls back to a bit at a time: the
+// columns run along z but the slices need rows of bits along y. The vector
+// kernels work one x at a time on the contiguous padded columns
+// columns[x + 1][1..]: zFaceRows*() computes CHUNK_DEPTH face rows (bits z)
+// against the columns shifted by one voxel, then they are bit-transposed
+// with movemask: byte plane g of the rows holds bits z = 8g..8g+7, and each
+// movemask of it reads one bit of every row, i.e. one output row of bits y.
+
+static_assert(CHUNK_DEPTH == 16 || CHUNK_DEPTH == 32,
+              "vector mesh kernels handle 16^3 and 32^3 chunks");
+static constexpr int PLANE_COUNT = CHUNK_DEPTH / 8;
+static constexpr int PLANE_HALVES = CHUNK_DEPTH / 16;
+
+TARGET_SSE41 static inline __m128i zFacesSSE41(__m128i column,
+                                               int direction) {
+  __m128i faces;
+  if constexpr (sizeof(PaddedColumn) == 4) {
+    __m128i covered = direction > 0 ? _mm_srli_epi32(column, 1)
+                                    : _mm_slli_epi32(column, 1);
+    faces = _mm_srli_epi32(_mm_andnot_si128(covered, column), 1);
+    return _mm_and_si128(faces, _mm_set1_epi32(0xFFFF));
+  } else {
+    __m128i covered = direction > 0 ? _mm_srli_epi64(column, 1)
+                                    : _mm_slli_epi64(column, 1);
+    faces = _mm_srli_epi64(_mm_andnot_si128(covered, column), 1);
+    return _mm_and_si128(faces, _mm_set1_epi64x(0xFFFFFFFFll));
+  }
+}
+
+TARGET_SSE41 static void zFaceRowsSSE41(const PaddedColumn *columns,
+                                        int direction, ChunkColumn *rows) {
+  constexpr int LANES = 16 / sizeof(PaddedColumn);
+  for (int i = 0; i < CHUNK_DEPTH; i += 2 * LANES) {
+    __m128i f0 = zFacesSSE41(
+        _mm_loadu_si128((const __m128i *)(columns + i)), direction);
+    __m128i f1 = zFacesSSE41(
+        _mm_loadu_si128((const __m128i *)(columns + i + LANES)), direction);
+    __m128i narrowed;
+    if constexpr (sizeof(PaddedColumn) == 4)
+      narrowed = _mm_packus_epi32(f0, f1);
+    else
+      narrowed =
+          _mm_unpacklo_epi64(_mm_shuffle_epi32(f0, _MM_SHUFFLE(2, 0, 2, 0)),
+                             _mm_shuffle_epi32(f1, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_si128((__m128i *)(rows + i), narrowed);
+  }
+}
+
+// Low and high bytes of 16 16-bit values, in order.
+TARGET_SSE41 __attribute__((always_inline)) static inline void
+splitBytesSSE41(__m128i lo8, __m128i hi8, __m128i &byte0, __m128i &byte1) {
+  const __m128i lowBytes = _mm_set1_epi16(0xFF);
+  byte0 = _mm_packus_epi16(_mm_and_si128(lo8, lowBytes),
+                           _mm_and_si128(hi8, lowBytes));
+  byte1 = _mm_packus_epi16(_mm_srli_epi16(lo8, 8), _mm_srli_epi16(hi8, 8));
+}
+
+// planes[g][h]: byte g of rows 16h..16h+15. Always inlined, so the AVX2
+// kernel gets it VEX-encoded instead of switching between SSE and AVX code.
+TARGET_SSE41 __attribute__((always_inline)) static inline void
+bytePlanesSSE41(const ChunkColumn *rows,
+                __m128i planes[PLANE_COUNT][PLANE_HALVES]) {
+  for (int h = 0; h < PLANE_HALVES; ++h) {
+    const ChunkColumn *half = rows + 16 * h;
+    if constexpr (sizeof(ChunkColumn) == 2) {
+      __m128i r0 = _mm_loadu_si128((const __m128i *)half);
+      __m128i r1 = _mm_loadu_si128((const __m128i *)(half + 8));
+      splitBytesSSE41(r0, r1, planes[0][h], planes[1][h]);
+    } else {
+      // Split each 32-bit row into 16-bit halves first.
+      const __m128i lowWords = _mm_set1_epi32(0xFFFF);
+      __m128i r[4];
+      for (int j = 0; j < 4; ++j)
+        r[j] = _mm_loadu_si128((const __m128i *)(half + 4 * j));
+      __m128i lo0 = _mm_packus_epi32(_mm_and_si128(r[0], lowWords),
+                                     _mm_and_si128(r[1], lowWords));
+      __m128i lo1 = _mm_packus_epi32(_mm_and_si128(r[2], lowWords),
+                                     _mm_and_si128(r[3], lowWords));
+      __m128i hi0 = _mm_packus_epi32(_mm_srli_epi32(r[0], 16),
+                                     _mm_srli_epi32(r[1], 16));
+      __m128i hi1 = _mm_packus_epi32(_mm_srli_epi32(r[2], 16),
+                                     _mm_srli_epi32(r[3], 16));
+      splitBytesSSE41(lo0, lo1, planes[0][h], planes[1][h]);
+      splitBytesSSE41(hi0, hi1, planes[2][h], planes[3][h]);
+    }
+  }
+}
+
+TARGET_SSE41 static void transposeSSE41(
+    const ChunkColumn *rows, int x,
+    ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH]) {
+  __m128i planes[PLANE_COUNT][PLANE_HALVES];
+  bytePlanesSSE41(rows, planes);
+  for (int g = 0; g < PLANE_COUNT; ++g) {
+    for (int bit = 7; bit >= 0; --bit) {
+      uint32_t row = (uint32_t)_mm_movemask_epi8(planes[g][0]);
+      if constexpr (PLANE_HALVES == 2)
+        row |= (uint32_t)_mm_movemask_epi8(planes[g][1]) << 16;
+      faceMasks[8 * g + bit][x] = (ChunkColumn)row;
+      // Bring the next lower bit of every byte up to bit 7.
+      for (int h = 0; h < PLANE_HALVES; ++h)
+        planes[g][h] = _mm_add_epi8(planes[g][h], planes[g][h]);
+    }
+  }
+}
+
+TARGET_SSE41 static void buildFaceMasksSSE41(
+    const PaddedColumn columns[PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE], int d,
+    int direction, ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH]) {
+  if (d < 2) {
+    buildFaceMasksXY(columns, d, direction, faceMasks);
+    return;
+  }
+
+  alignas(16) ChunkColumn rows[CHUNK_DEPTH];
+  for (int x = 0; x < CHUNK_WIDTH; ++x) {
+    zFaceRowsSSE41(&columns[x + 1][1], direction, rows);
+    transposeSSE41(rows, x, faceMasks);
+  }
+}
+
+TARGET_AVX2 static inline __m256i zFacesAVX2(__m256i column, int direction) {
+  __m256i faces;
+  if constexpr (sizeof(PaddedColumn) == 4) {
+    __m256i covered = direction > 0 ? _mm256_srli_epi32(column, 1)
+                                    : _mm256_slli_epi32(column, 1);
+    faces = _mm256_srli_epi32(_mm256_andnot_si256(covered, column), 1);
+    return _mm256_and_si256(faces, _mm256_set1_epi32(0xFFFF));
+  } else {
+    __m256i covered = direction > 0 ? _mm256_srli_epi64(column, 1)
+                                    : _mm256_slli_epi64(column, 1);
+    faces = _mm256_srli_epi64(_mm256_andnot_si256(covered, column), 1);
+    return _mm256_and_si256(faces, _mm256_set1_epi64x(0xFFFFFFFFll));
+  }
+}
+
+TARGET_AVX2 static void zFaceRowsAVX2(const PaddedColumn *columns,
+                                      int direction, ChunkColumn *rows) {
+  constexpr int LANES = 32 / sizeof(PaddedColumn);
+  for (int i = 0; i < CHUNK_DEPTH; i += 2 * LANES) {
+    __m256i f0 = zFacesAVX2(
+        _mm256_loadu_si256((const __m256i *)(columns + i)), direction);
+    __m256i f1 = zFacesAVX2(
+        _mm256_loadu_si256((const __m256i *)(columns + i + LANES)), direction);
+    // The packs work per 128-bit lane; permute the lanes back into order.
+    __m256i narrowed;
+    if constexpr (sizeof(PaddedColumn) == 4) {
+      narrowed = _mm256_permute4x64_epi64(_mm256_packus_epi32(f0, f1),
+                                          _MM_SHUFFLE(3, 1, 2, 0));
+    } else {
+      const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+      narrowed = _mm256_permute2x128_si256(
+          _mm256_permutevar8x32_epi32(f0, evens),
+          _mm256_permutevar8x32_epi32(f1, evens), 0x20);
+    }
+    _mm256_storeu_si256((__m256i *)(rows + i), narrowed);
+  }
+}
+
+// Same planes as the SSE4.1 path, but two 16-byte planes share one register,
+// so each movemask yields a full 32-voxel row or two 16-voxel rows.
+TARGET_AVX2 static void transposeAVX2(
+    const ChunkColumn *rows, int x,
+    ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH]) {
+  __m128i planes[PLANE_COUNT][PLANE_HALVES];
+  bytePlanesSSE41(rows, planes);
+
+  constexpr int PAIRS = (PLANE_HALVES == 2) ? PLANE_COUNT : PLANE_COUNT / 2;
+  __m256i pairs[PAIRS];
+  for (int p = 0; p < PAIRS; ++p) {
+    __m128i lo = (PLANE_HALVES == 2) ? planes[p][0] : planes[2 * p][0];
+    __m128i hi = (PLANE_HALVES == 2) ? planes[p][1] : planes[2 * p + 1][0];
+    pairs[p] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+  }
+
+  for (int bit = 7; bit >= 0; --bit) {
+    for (int p = 0; p < PAIRS; ++p) {
+      uint32_t bits = (uint32_t)_mm256_movemask_epi8(pairs[p]);
+      if constexpr (PLANE_HALVES == 2) {
+        faceMasks[8 * p + bit][x] = (ChunkColumn)bits;
+      } else {
+        faceMasks[16 * p + bit][x] = (ChunkColumn)bits;
+        faceMasks[16 * p + 8 + bit][x] = (ChunkColumn)(bits >> 16);
+      }
+      pairs[p] = _mm256_add_epi8(pairs[p], pairs[p]);
+    }
+  }
+}
+
+TARGET_AVX2 static void buildFaceMasksAVX2(
+    const PaddedColumn columns[PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE], int d,
+    int direction, ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH]) {
+  if (d < 2) {
+    buildFaceMasksXY(columns, d, direction, faceMasks);
+    return;
+  }
+
+  alignas(32) ChunkColumn rows[CHUNK_DEPTH];
+  for (int x = 0; x < CHUNK_WIDTH; ++x) {
+    zFaceRowsAVX2(&columns[x + 1][1], direction, rows);
+    transposeAVX2(rows, x, faceMasks);
+  }
+}
+
+#endif // MESH_KERNELS_X86
+
+namespace MeshKernels {
+
+bool isSupported(MeshKernelIsa isa) {
+  switch (isa) {
+  case MeshKernelIsa::SCALAR:
+    return true;
+#ifdef MESH_KERNELS_X86
+  case MeshKernelIsa::SSE41:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1");
+  case MeshKernelIsa::AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+MeshKernelIsa getBestIsa() {
+  if (isSupported(MeshKernelIsa::AVX2))
+    return MeshKernelIsa::AVX2;
+  if (isSupported(MeshKernelIsa::SSE41))
+    return MeshKernelIsa::SSE41;
+  return MeshKernelIsa::SCALAR;
+}
+
+const char *getIsaName(MeshKernelIsa isa) {
+  switch (isa) {
+  case MeshKernelIsa::SSE41:
+    return "SSE4.1";
+  case MeshKernelIsa::AVX2:
+    return "AVX2";
+  default:
+    return "scalar";
+  }
+}
+
+FaceMaskKernel getFaceMaskKernel(MeshKernelIsa isa) {
+  if (!isSupported(isa))
+    return buildFaceMasksScalar;
+
+  switch (isa) {
+#ifdef MESH_KERNELS_X86
+  case MeshKernelIsa::SSE41:
+    return buildFaceMasksSSE41;
+  case MeshKernelIsa::AVX2:
+    return buildFaceMasksAVX2;
+#endif
+  default:
+    return buildFaceMasksScalar;
+  }
+}
+
+// Resolved once, on first use; mesh workers only ever load the pointer.
+struct ActiveKernel {
+  std::atomic<MeshKernelIsa> isa;
+  std::atomic<FaceMaskKernel> kernel;
+
+  ActiveKernel()
+      : isa(getBestIsa()), kernel(getFaceMaskKernel(isa.load())) {}
+};
+
+static ActiveKernel &activeKernel() {
+  static ActiveKernel active;
+  return active;
+}
+
+bool setActiveIsa(MeshKernelIsa isa) {
+  if (!isSupported(isa))
+    return false;
+  ActiveKernel &active = activeKernel();
+  active.kernel.store(getFaceMaskKernel(isa), std::memory_order_relaxed);
+  active.isa.store(isa, std::memory_order_relaxed);
+  return true;
+}
+
+MeshKernelIsa getActiveIsa() {
+  return activeKernel().isa.load(std::memory_order_relaxed);
+}
+
+FaceMaskKernel getActiveFaceMaskKernel() {
+  return activeKernel().kernel.load(std::memory_order_relaxed);
+}
+
+} // namespace MeshKernels
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "chunk.hpp"
+
+// Face-mask kernels for the binary mesher.
+//
+// A kernel fills faceMasks[slice][row] for one face direction: one bit per
+// voxel along the slice's v axis for every face that should be drawn (solid
+// here, empty on the other side), read off the padded occupancy columns of a
+// ChunkMeshInput. Every kernel produces exactly the same masks; they only
+// differ in how many columns they process per instruction. The x86 kernels
+// are built with per-function target attributes, so the rest of the program
+// needs no ISA flags, and picked at runtime from what the CPU supports.
+enum class MeshKernelIsa { SCALAR, SSE41, AVX2 };
+
+typedef void (*FaceMaskKernel)(
+    const PaddedColumn columns[PADDED_CHUNK_SIZE][PADDED_CHUNK_SIZE], int d,
+    int direction, ChunkColumn faceMasks[CHUNK_DEPTH][CHUNK_DEPTH]);
+
+namespace MeshKernels {
+
+bool isSupported(MeshKernelIsa isa);
+// The widest ISA this CPU supports.
+MeshKernelIsa getBestIsa();
+const char *getIsaName(MeshKernelIsa isa);
+
+// Kernel for a given ISA; the scalar kernel when the ISA isn't supported.
+FaceMaskKernel getFaceMaskKernel(MeshKernelIsa isa);
+
+// The kernel the mesher calls: getBestIsa() until overridden. Returns false
+// (and keeps the current kernel) for an unsupported ISA.
+bool setActiveIsa(MeshKernelIsa isa);
+MeshKernelIsa getActiveIsa();
+FaceMaskKernel getActiveFaceMaskKernel();
+
+} // namespace MeshKernels
@@ -1,6 +1,6 @@
 #include "shader.hpp"
 
-Shader::Shader(const char *vertexPath, const char *fragmentPath)
+Shader::Shader(const char *vertexPath, const char *fragmentPath, const std::string &defines)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
@@ -30,6 +30,8 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
     }
+    insertDefines(vertexCode, defines);
+    insertDefines(fragmentCode, defines);
     const char *vShaderCode = vertexCode.c_str();
     const char *fShaderCode = fragmentCode.c_str();
     // 2. compile shaders
@@ -123,4 +125,4 @@ Shader::Shader(const char *vertexPath, const char *geometryPath, const char *fra
     glDeleteShader(vertex);
     glDeleteShader(geometry);
     glDeleteShader(fragment);
-}
\ No newline at end of file
+}
\ No newline at end of file
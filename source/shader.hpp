@@ -16,7 +16,8 @@ public:
     unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath);
+    // defines (e.g. "#define FOO 1\n") are inserted after each stage's #version line
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string &defines = "");
     Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath);
 
     // activate the shader
@@ -68,6 +69,13 @@ public:
     }
 
 private:
+    static void insertDefines(std::string &code, const std::string &defines)
+    {
+        if (defines.empty())
+            return;
+        size_t lineEnd = code.find('\n');
+        code.insert(lineEnd == std::string::npos ? code.size() : lineEnd + 1, defines);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
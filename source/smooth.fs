@@ -0,0 +1,16 @@
+#version 410 core
+out vec4 FragColor;
+
+in vec3 fsWorldPosition;
+
+const vec3 terrainColor = vec3(0.35, 0.7, 0.3);
+const vec3 lightDirection = vec3(0.4, 0.8, 0.3);
+
+void main()
+{
+    // Vertices carry no normal; the triangle's own comes from the position
+    // derivatives, which gives a faceted look.
+    vec3 normal = normalize(cross(dFdx(fsWorldPosition), dFdy(fsWorldPosition)));
+    float diffuse = max(dot(normal, normalize(lightDirection)), 0.0);
+    FragColor = vec4(terrainColor * (0.35 + 0.65 * diffuse), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 410 core
+layout (location = 0) in uint vertexData;    // Per-vertex: fixed-point lattice position
+
+uniform uint instanceData;                   // Per-draw: chunk pos
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 fsWorldPosition;
+
+// Vertex data unpacking (32-bit). CHUNK_SIZE and the SMOOTH_VERTEX_* layout
+// constants are #defined by the host from voxel.hpp.
+#define COORD_MASK ((1u << SMOOTH_VERTEX_COORD_BITS) - 1u)
+#define GET_X(data) (((data) >> 0u) & COORD_MASK)
+#define GET_Y(data) (((data) >> SMOOTH_VERTEX_COORD_BITS) & COORD_MASK)
+#define GET_Z(data) (((data) >> (2u * SMOOTH_VERTEX_COORD_BITS)) & COORD_MASK)
+
+// Instance data unpacking (32-bit)
+#define GET_CHUNK_X(data) ((((data) >> 0u) & 0x3FFu) - 512u)
+#define GET_CHUNK_Y(data) ((((data) >> 10u) & 0x3FFu) - 512u)
+#define GET_CHUNK_Z(data) ((((data) >> 20u) & 0xFFFu) - 2048u)
+
+void main() {
+    // Lattice coordinate i is the center of voxel i - 1 of the chunk.
+    vec3 lattice = vec3(GET_X(vertexData), GET_Y(vertexData), GET_Z(vertexData)) /
+                   float(1u << SMOOTH_VERTEX_FRAC_BITS);
+
+    int chunkX = int(GET_CHUNK_X(instanceData));
+    int chunkY = int(GET_CHUNK_Y(instanceData));
+    int chunkZ = int(GET_CHUNK_Z(instanceData));
+    vec3 chunkOrigin = vec3(ivec3(chunkX, chunkY, chunkZ) * ivec3(CHUNK_SIZE));
+
+    fsWorldPosition = chunkOrigin + lattice - 0.5;
+
+    mat4 pv = projection * view;
+    gl_Position = pv * vec4(fsWorldPosition, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "surfaceNets.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr int LATTICE = PADDED_CHUNK_SIZE; // lattice points per axis
+constexpr int CELLS = LATTICE - 1;         // cells per axis
+constexpr uint16_t NO_VERTEX = 0xFFFF;
+static_assert(CELLS * CELLS * CELLS < NO_VERTEX,
+              "every cell's vertex must have a 16-bit index");
+
+// Per-thread working set: the densities sampled so far (NaN = not yet)
+// and the vertex of each cell (NO_VERTEX = not yet).
+struct Scratch {
+  float density[LATTICE][LATTICE][LATTICE];
+  uint16_t vertexIndex[CELLS][CELLS][CELLS];
+};
+
+// A cell's eight corners, as offsets from its lowest one, and its twelve
+// edges as pairs of corners.
+const glm::ivec3 CORNERS[8] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0},
+                               {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}};
+const int EDGES[12][2] = {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3},
+                          {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+class SurfaceNetsMesher {
+public:
+  SurfaceNetsMesher(const ChunkMeshInput &input, const glm::ivec3 &origin,
+                    Scratch &scratch, ChunkMesh &mesh)
+      : input(input), origin(origin), scratch(scratch), mesh(mesh) {}
+
+  // Emits the quad around the edge from p along axis d; pSolid says which
+  // end is solid, and so which way the quad faces.
+  void emitQuad(const glm::ivec3 &p, int d, bool pSolid) {
+    glm::ivec3 du(0), dv(0);
+    du[(d + 1) % 3] = 1;
+    dv[(d + 2) % 3] = 1;
+    // Counter-clockwise around +d.
+    uint16_t c00 = getVertex(p - du - dv);
+    uint16_t c10 = getVertex(p - dv);
+    uint16_t c11 = getVertex(p);
+    uint16_t c01 = getVertex(p - du);
+    std::vector<uint16_t> &indices = mesh.smoothIndices;
+    if (pSolid)
+      indices.insert(indices.end(), {c00, c10, c11, c00, c11, c01});
+    else
+      indices.insert(indices.end(), {c00, c11, c10, c00, c01, c11});
+  }
+
+private:
+  float densityAt(const glm::ivec3 &p) {
+    float &d = scratch.density[p.x][p.y][p.z];
+    if (std::isnan(d))
+      d = input.smoothDensity(origin + p);
+    return d;
+  }
+
+  // Points past two chunk faces at once (edge and corner neighbors) come
+  // from the density: the input's edge cells only serve block occlusion,
+  // and aren't kept current for smooth meshes.
+  bool isSolid(const glm::ivec3 &p) {
+    int outside = (p.x == 0 || p.x == LATTICE - 1) +
+                  (p.y == 0 || p.y == LATTICE - 1) +
+                  (p.z == 0 || p.z == LATTICE - 1);
+    if (outside >= 2)
+      return densityAt(p) > 0.0f;
+    return (input.columns[p.x][p.y] >> p.z) & 1;
+  }
+
+  // The vertex of cell c (spanning points c .. c + 1), created on first
+  // use at the average of its edges' zero crossings. Where the density
+  // disagrees with the voxels (e.g. an edited voxel) an edge crosses at
+  // its middle.
+  uint16_t getVertex(const glm::ivec3 &c) {
+    uint16_t &index = scratch.vertexIndex[c.x][c.y][c.z];
+    if (index != NO_VERTEX)
+      return index;
+
+    bool solid[8];
+    for (int i = 0; i < 8; ++i)
+      solid[i] = isSolid(c + CORNERS[i]);
+
+    // Summed relative to the cell and snapped to the packed precision
+    // before c is added, so both chunks sharing a boundary cell come out
+    // with bit-identical vertices.
+    glm::vec3 sum(0.0f);
+    int crossings = 0;
+    for (const int *edge : EDGES) {
+      if (solid[edge[0]] == solid[edge[1]])
+        continue;
+      glm::ivec3 in = CORNERS[solid[edge[0]] ? edge[0] : edge[1]];
+      glm::ivec3 out = CORNERS[solid[edge[0]] ? edge[1] : edge[0]];
+      float dIn = densityAt(c + in);
+      float dOut = densityAt(c + out);
+      float t = 0.5f;
+      if (dIn >= 0.0f && dOut <= 0.0f && dIn > dOut)
+        t = dIn / (dIn - dOut);
+      sum += glm::vec3(in) + t * glm::vec3(out - in);
+      ++crossings;
+    }
+    const float scale = (float)(1u << Voxel::SMOOTH_VERTEX_FRAC_BITS);
+    glm::vec3 local = glm::floor(sum / (float)crossings * scale + 0.5f) / scale;
+
+    index = (uint16_t)mesh.smoothVertices.size();
+    mesh.smoothVertices.push_back(
+        Voxel::packSmoothVertex(glm::vec3(c) + local));
+    return index;
+  }
+
+  const ChunkMeshInput &input;
+  const glm::ivec3 origin;
+  Scratch &scratch;
+  ChunkMesh &mesh;
+};
+
+} // namespace
+
+void SurfaceNets::meshChunk(const ChunkMeshInput &input,
+                            const glm::ivec3 &chunkPosition,
+                            ChunkMesh &mesh) {
+  static thread_local Scratch scratch;
+  std::fill(&scratch.density[0][0][0],
+            &scratch.density[0][0][0] + LATTICE * LATTICE * LATTICE,
+            std::numeric_limits<float>::quiet_NaN());
+  std::fill(&scratch.vertexIndex[0][0][0],
+            &scratch.vertexIndex[0][0][0] + CELLS * CELLS * CELLS, NO_VERTEX);
+
+  // Lattice point 0 is voxel -1 of the chunk.
+  SurfaceNetsMesher mesher(input, chunkPosition * CHUNK_SIZE - glm::ivec3(1),
+                           scratch, mesh);
+
+  // Edges leaving the chunk's own points, 1 .. CHUNK_SIZE on every axis. A
+  // whole column of z edges is one XOR with the column shifted by one; x
+  // and y edges are an XOR with the next column over.
+  const PaddedColumn own = ((PaddedColumn(1) << CHUNK_DEPTH) - 1) << 1;
+  for (int x = 1; x <= CHUNK_WIDTH; ++x) {
+    for (int y = 1; y <= CHUNK_HEIGHT; ++y) {
+      const PaddedColumn column = input.columns[x][y];
+      const PaddedColumn crossing[3] = {
+          (PaddedColumn)((column ^ input.columns[x + 1][y]) & own),
+          (PaddedColumn)((column ^ input.columns[x][y + 1]) & own),
+          (PaddedColumn)((column ^ (column >> 1)) & own)};
+      for (int d = 0; d < 3; ++d) {
+        for (PaddedColumn bits = crossing[d]; bits != 0; bits &= bits - 1) {
+          int z = __builtin_ctzll(bits);
+          mesher.emitQuad(glm::ivec3(x, y, z), d, (column >> z) & 1);
+        }
+      }
+    }
+  }
+}
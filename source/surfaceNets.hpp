@@ -0,0 +1,36 @@
+#pragma once
+
+#include "chunk.hpp"
+
+// Smooth terrain meshing with Naive Surface Nets.
+//
+// The mesher works on the lattice of voxel centers that a padded
+// ChunkMeshInput covers: lattice coordinate i is voxel i - 1 of the chunk.
+// Each lattice edge from a solid to an empty point gets a quad joining the
+// four cells around it, and each cell a quad touches gets one vertex. The cell vertices
+// are shared by every quad that touches them, so a mesh is indexed
+// triangles.
+//
+// Which points are solid comes from the input's voxels, so edits show up
+// and the surface encloses exactly the blocks the greedy mesher would
+// draw. The terrain density (input.smoothDensity) only places each vertex,
+// at the average of the points where its cell's edges cross zero. Cells
+// and edges are found a whole column at a time with bit operations on the
+// padded occupancy columns, and density is only sampled around the cells
+// that carry a vertex.
+//
+// A chunk emits the quads for the edges leaving its own voxels in the +x,
+// +y and +z directions. A cell on the boundary is computed by both chunks
+// from the same points, so the seams close. The input has no voxels from
+// the edge and corner neighbors, so those points are solid where the
+// density is positive. A voxel edited against the density along a chunk
+// edge can therefore leave a small crack beside it.
+namespace SurfaceNets {
+
+// Meshes input, captured for the chunk at chunkPosition, into
+// mesh.smoothVertices and mesh.smoothIndices. input.smoothDensity must be
+// set.
+void meshChunk(const ChunkMeshInput &input, const glm::ivec3 &chunkPosition,
+               ChunkMesh &mesh);
+
+} // namespace SurfaceNets
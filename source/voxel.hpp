@@ -2,6 +2,9 @@
 
 #include <glm/glm.hpp>
 #include <cstdint>
+#include <string>
+
+#include "chunkSize.hpp"
 
 namespace Voxel
 {
@@ -44,32 +47,100 @@ enum VoxelColor : uint8_t {
     BLACK   = 8
 };
 
-// 32-bit vertex layout (per-vertex data):
-// Local voxel x: 4 bits (0-15)      - bits 0-3
-// Local voxel y: 4 bits (0-15)      - bits 4-7
-// Local voxel z: 4 bits (0-15)      - bits 8-11
-// length: 4 bits (1-16)             - bits 12-15
-// height: 4 bits (1-16)             - bits 16-19
-// color: 8 bits (0-255)             - bits 20-27
-// facing: 3 bits (0-7)              - bits 28-30
-// (1 bit unused)                    - bit 31
+// 32-bit vertex layout (per-vertex data), with B = CHUNK_SIZE_BITS:
+// Local voxel x: B bits             - bits 0 .. B-1
+// Local voxel y: B bits             - bits B .. 2B-1
+// Local voxel z: B bits             - bits 2B .. 3B-1
+// length: B bits (1-CHUNK_SIZE)     - bits 3B .. 4B-1
+// height: B bits (1-CHUNK_SIZE)     - bits 4B .. 5B-1
+// occlusion: 8 bits, 16^3 only      - bits 5B .. 5B+7
+// color: the rest, up to 8 bits     - 4 bits at 16^3, 7 bits at 32^3
+// At 16^3 this is x/y/z 0-11, length 12-15, height 16-19, occlusion 20-27
+// and color 28-31. At 32^3 the 25 position and size bits leave no room for
+// occlusion, so those builds mesh without it.
+// There is no facing field: a chunk's quads are grouped by face and each
+// group is drawn with the face as a uniform.
+//
+// Occlusion is baked ambient occlusion, 2 bits per quad corner (3 = open,
+// 0 = darkest); corner 2 * uEnd + vEnd sits at bit 2 * corner, where uEnd
+// and vEnd are 0 at the quad's low u / v edge and 1 at the high one.
+constexpr uint32_t VERTEX_COORD_BITS  = CHUNK_SIZE_BITS;
+constexpr uint32_t VERTEX_COORD_MASK  = (1u << VERTEX_COORD_BITS) - 1;
+constexpr uint32_t VERTEX_AO_SHIFT    = 5 * VERTEX_COORD_BITS;
+constexpr uint32_t VERTEX_AO_BITS     = 32 - VERTEX_AO_SHIFT >= 8 + 4 ? 8 : 0;
+constexpr uint32_t VERTEX_COLOR_SHIFT = VERTEX_AO_SHIFT + VERTEX_AO_BITS;
+constexpr uint32_t VERTEX_COLOR_BITS  =
+    32 - VERTEX_COLOR_SHIFT < 8 ? 32 - VERTEX_COLOR_SHIFT : 8;
+constexpr uint32_t VERTEX_COLOR_MASK  = (1u << VERTEX_COLOR_BITS) - 1;
+static_assert(VERTEX_COLOR_BITS >= 4, "vertex color must hold every VoxelColor");
+
+// All four corners open; what quads carry when occlusion isn't baked.
+constexpr uint32_t VERTEX_AO_OPEN = 0xFF;
 
 inline PackedVoxel packVertexData(int localX, int localY, int localZ,
                                    int length, int height,
-                                   int colorIndex, int facing) {
+                                   int colorIndex,
+                                   uint32_t occlusion = VERTEX_AO_OPEN) {
+    const uint32_t B = VERTEX_COORD_BITS;
+    const uint32_t M = VERTEX_COORD_MASK;
     uint32_t packed = 0;
 
-    packed |= (localX & 0xF) << 0;          // bits 0-3
-    packed |= (localY & 0xF) << 4;          // bits 4-7
-    packed |= (localZ & 0xF) << 8;          // bits 8-11
-    packed |= ((length - 1) & 0xF) << 12;   // bits 12-15
-    packed |= ((height - 1) & 0xF) << 16;   // bits 16-19
-    packed |= (colorIndex & 0xFF) << 20;    // bits 20-27
-    packed |= (facing & 0x7) << 28;         // bits 28-30
+    packed |= (localX & M) << 0;
+    packed |= (localY & M) << B;
+    packed |= (localZ & M) << (2 * B);
+    packed |= ((length - 1) & M) << (3 * B);
+    packed |= ((height - 1) & M) << (4 * B);
+    if (VERTEX_AO_BITS != 0)
+        packed |= (occlusion & VERTEX_AO_OPEN) << VERTEX_AO_SHIFT;
+    packed |= (colorIndex & VERTEX_COLOR_MASK) << VERTEX_COLOR_SHIFT;
 
     return packed;
 }
 
+// Shader #defines matching the vertex layout above, for base.vs.
+inline std::string vertexLayoutDefines() {
+    return "#define CHUNK_SIZE " + std::to_string(CHUNK_SIZE) + "\n"
+           "#define VERTEX_COORD_BITS " + std::to_string(VERTEX_COORD_BITS) + "u\n"
+           "#define VERTEX_AO_SHIFT " + std::to_string(VERTEX_AO_SHIFT) + "u\n"
+           "#define VERTEX_AO_BITS " + std::to_string(VERTEX_AO_BITS) + "u\n"
+           "#define VERTEX_COLOR_SHIFT " + std::to_string(VERTEX_COLOR_SHIFT) + "u\n"
+           "#define VERTEX_COLOR_MASK " + std::to_string(VERTEX_COLOR_MASK) + "u\n";
+}
+
+// Smooth terrain vertex (see SurfaceNets), 32 bits: x, y and z at 10 bits
+// each, bits 30-31 unused. They are fixed point with
+// SMOOTH_VERTEX_FRAC_BITS fraction bits (5 at 16^3, 4 at 32^3), in the
+// mesher's lattice units: lattice coordinate i is the center of voxel
+// i - 1 of the chunk, and vertices lie in 0 .. CHUNK_SIZE + 1.
+typedef uint32_t PackedSmoothVertex;
+
+constexpr uint32_t SMOOTH_VERTEX_COORD_BITS = 10;
+constexpr uint32_t SMOOTH_VERTEX_FRAC_BITS  =
+    SMOOTH_VERTEX_COORD_BITS - (CHUNK_SIZE_BITS + 1);
+static_assert(((CHUNK_SIZE + 1u) << SMOOTH_VERTEX_FRAC_BITS) <
+                  (1u << SMOOTH_VERTEX_COORD_BITS),
+              "smooth vertex must reach the far lattice corner");
+
+inline PackedSmoothVertex packSmoothVertex(const glm::vec3 &latticePos) {
+    const float scale = (float)(1u << SMOOTH_VERTEX_FRAC_BITS);
+    const uint32_t M = (1u << SMOOTH_VERTEX_COORD_BITS) - 1;
+    const uint32_t B = SMOOTH_VERTEX_COORD_BITS;
+    uint32_t packed = 0;
+
+    packed |= ((uint32_t)(latticePos.x * scale + 0.5f) & M) << 0;
+    packed |= ((uint32_t)(latticePos.y * scale + 0.5f) & M) << B;
+    packed |= ((uint32_t)(latticePos.z * scale + 0.5f) & M) << (2 * B);
+
+    return packed;
+}
+
+// Shader #defines matching the smooth vertex layout, for smooth.vs.
+inline std::string smoothVertexLayoutDefines() {
+    return "#define CHUNK_SIZE " + std::to_string(CHUNK_SIZE) + "\n"
+           "#define SMOOTH_VERTEX_COORD_BITS " + std::to_string(SMOOTH_VERTEX_COORD_BITS) + "u\n"
+           "#define SMOOTH_VERTEX_FRAC_BITS " + std::to_string(SMOOTH_VERTEX_FRAC_BITS) + "u\n";
+}
+
 // 32-bit instance layout (per-chunk data):
 // Chunk X: 10 bits (0-1023)         - bits 0-9   (supports -512 to +511 with offset)
 // Chunk Y: 10 bits (0-1023)         - bits 10-19 (supports -512 to +511 with offset)
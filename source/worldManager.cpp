@@ -2,20 +2,33 @@
 #include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <limits>
 #include <thread>
 
 WorldManager::WorldManager(int renderDistance)
-    : RENDER_DISTANCE(renderDistance) {
-  initLoadingOffsets();
-}
+    : chunkPool(ChunkPool::capacityForRenderDistance(
+                    renderDistance, LOAD_BELOW + LOAD_ABOVE + 1),
+                true),
+      chunkRegistry(ChunkPool::capacityForRenderDistance(
+          renderDistance, LOAD_BELOW + LOAD_ABOVE + 1)),
+      chunkGrid(glm::ivec3(renderDistance + UNLOAD_MARGIN,
+                           LOAD_BELOW + UNLOAD_MARGIN_Y,
+                           renderDistance + UNLOAD_MARGIN),
+                glm::ivec3(renderDistance + UNLOAD_MARGIN,
+                           LOAD_ABOVE + UNLOAD_MARGIN_Y,
+                           renderDistance + UNLOAD_MARGIN)),
+      RENDER_DISTANCE(renderDistance) {}
 
 WorldManager::~WorldManager() {
   stop();
+  reclaimer.collectAll();
+  cleanUpDeletedChunks();
   std::unique_lock<std::shared_mutex> lock(chunk_map_mutex);
-  for (auto &pair : chunk_map) {
-    delete pair.second;
-  }
-  chunk_map.clear();
+  chunkGrid.forEach([this](Chunk *chunk) {
+    uint32_t slot = chunk->registrySlot;
+    chunkPool.release(chunk);
+    chunkRegistry.release(slot);
+  });
 }
 
 void WorldManager::start(ThreadPool *loadingThreadPool,
@@ -26,21 +39,139 @@ void WorldManager::start(ThreadPool *loadingThreadPool,
   gameThread = std::thread(&WorldManager::gameLoop, this);
 }
 
-void WorldManager::initLoadingOffsets() {
-  for (int x = -RENDER_DISTANCE; x <= RENDER_DISTANCE; ++x) {
-    for (int y = -4; y <= 7; ++y) {
-      for (int z = -RENDER_DISTANCE; z <= RENDER_DISTANCE; ++z) {
-        loadingOffsets.push_back(glm::ivec3(x, y, z));
+glm::ivec3 WorldManager::worldToChunk(const glm::vec3 &worldPos) {
+  return glm::ivec3(glm::floor(worldPos / (float)CHUNK_SIZE));
+}
+
+glm::ivec3 WorldManager::getLoadCenter(const glm::ivec3 &cameraChunk) {
+  return glm::ivec3(cameraChunk.x, std::min(cameraChunk.y, LOAD_BELOW),
+                    cameraChunk.z);
+}
+
+float WorldManager::terrainHeight(float worldX, float worldZ) {
+  float persistence = 0.5f;
+  float lacunarity = 2.0f;
+  int octaves = 4;
+
+  float initialFrequency = 0.005f;
+
+  float amplitude = 1.0f;
+  float totalNoise = 0.0f;
+  float amplitudeSum = 0.0f;
+  float frequency = initialFrequency;
+
+  for (int i = 0; i < octaves; ++i) {
+    float perlinValue = glm::perlin(glm::vec2(worldX, worldZ) * frequency);
+    totalNoise += perlinValue * amplitude;
+    amplitudeSum += amplitude;
+
+    amplitude *= persistence;
+    frequency *= lacunarity;
+  }
+
+  float normalizedNoise = (amplitudeSum > 0.0f) ? (totalNoise / amplitudeSum) : 0.0f;
+  normalizedNoise = glm::clamp(normalizedNoise, -1.0f, 1.0f);
+
+  return ((normalizedNoise + 1.0f) / 2.0f) * MAX_HEIGHT;
+}
+
+float WorldManager::caveDensity(const glm::ivec3 &worldVoxel) {
+  // Caves thin out towards the surface across the top two 16-voxel bands
+  // and keep a constant density below them.
+  float threshold = 0.565f;
+  if (worldVoxel.y >= 0)
+    threshold = 0.4f - worldVoxel.y * 0.02f;
+  else if (worldVoxel.y >= -16)
+    threshold = 0.4f - worldVoxel.y * 0.01f;
+
+  float noisevalue = glm::perlin(glm::vec3(worldVoxel) * 0.01f);
+  float density = glm::clamp((noisevalue + 1.0f) / 2.0f, 0.0f, 1.0f);
+  return density - threshold;
+}
+
+float WorldManager::terrainDensity(const glm::ivec3 &worldVoxel) {
+  if (worldVoxel.y >= TERRAIN_CAVE_TOP) {
+    // Solid voxels have y + 1 <= height; one exactly at the surface must
+    // still come out positive.
+    float d = terrainHeight((float)worldVoxel.x, (float)worldVoxel.z) -
+              (worldVoxel.y + 1);
+    return d < 0.0f ? d : std::max(d, std::numeric_limits<float>::min());
+  }
+  return caveDensity(worldVoxel);
+}
+
+// Terrain is defined per world voxel, so the same world comes out whatever
+// CHUNK_SIZE is: a 2D heightmap surface from TERRAIN_CAVE_TOP up, and 3D
+// noise caves below it, denser towards the surface. Returns false if the
+// chunk came out empty.
+bool WorldManager::generateTerrain(const glm::ivec3 &chunkPos,
+                                   ChunkVoxels &voxels) {
+  int chunkBottomY = chunkPos.y * CHUNK_HEIGHT;
+  int chunkTopY = chunkBottomY + CHUNK_HEIGHT;
+
+  int heightMap[CHUNK_WIDTH][CHUNK_DEPTH];
+  int minHeight = MAX_HEIGHT;
+  if (chunkTopY > TERRAIN_CAVE_TOP) {
+    for (int x = 0; x < CHUNK_WIDTH; ++x) {
+      for (int z = 0; z < CHUNK_DEPTH; ++z) {
+        float worldX = x + chunkPos.x * CHUNK_WIDTH;
+        float worldZ = z + chunkPos.z * CHUNK_DEPTH;
+        heightMap[x][z] = static_cast<int>(terrainHeight(worldX, worldZ));
+        minHeight = std::min(minHeight, heightMap[x][z]);
+      }
+    }
+
+    // Every column reaches above this chunk: store it as uniform solid
+    // instead of setting every voxel one at a time.
+    if (chunkBottomY >= TERRAIN_CAVE_TOP && minHeight >= chunkTopY) {
+      voxels.fill(Voxel::GREEN);
+      return true;
+    }
+  }
+
+  // Above the caves the chunk is just the heightmap: fill it column by
+  // column.
+  if (chunkBottomY >= TERRAIN_CAVE_TOP) {
+    voxels.fillFromHeightmap(&heightMap[0][0], chunkBottomY, Voxel::GREEN);
+    return voxels.countSolid() > 0;
+  }
+
+  // Threshold into occupancy columns first and count solids, so a fully
+  // solid chunk can be stored uniform without ever growing a packed voxel
+  // array.
+  ChunkColumn solidColumns[CHUNK_WIDTH][CHUNK_HEIGHT];
+  int solidCount = 0;
+  for (int x = 0; x < CHUNK_WIDTH; ++x) {
+    for (int y = 0; y < CHUNK_HEIGHT; ++y) {
+      int worldY = y + chunkBottomY;
+      ChunkColumn solid = 0;
+      if (worldY >= TERRAIN_CAVE_TOP) {
+        for (int z = 0; z < CHUNK_DEPTH; ++z)
+          solid |= (ChunkColumn)(worldY < heightMap[x][z]) << z;
+        solidColumns[x][y] = solid;
+        solidCount += __builtin_popcountll(solid);
+        continue;
+      }
+
+      for (int z = 0; z < CHUNK_DEPTH; ++z) {
+        glm::ivec3 worldVoxel(x + chunkPos.x * CHUNK_WIDTH, worldY,
+                              z + chunkPos.z * CHUNK_DEPTH);
+        solid |= (ChunkColumn)(caveDensity(worldVoxel) > 0.0f) << z;
       }
+      solidColumns[x][y] = solid;
+      solidCount += __builtin_popcountll(solid);
     }
   }
 
-  std::sort(loadingOffsets.begin(), loadingOffsets.end(),
-            [](const glm::ivec3 &a, const glm::ivec3 &b) {
-              float distA = a.x * a.x + a.y * a.y + a.z * a.z;
-              float distB = b.x * b.x + b.y * b.y + b.z * b.z;
-              return distA < distB;
-            });
+  if (solidCount == CHUNK_VOLUME) {
+    voxels.fill(Voxel::GREEN);
+  } else if (solidCount > 0) {
+    for (int x = 0; x < CHUNK_WIDTH; ++x) {
+      for (int y = 0; y < CHUNK_HEIGHT; ++y)
+        voxels.setColumn(x, y, solidColumns[x][y], Voxel::GREEN);
+    }
+  }
+  return solidCount > 0;
 }
 
 void WorldManager::stop() {
@@ -48,6 +179,9 @@ void WorldManager::stop() {
   if (gameThread.joinable()) {
     gameThread.join();
   }
+  // Nothing may be freed while a task still holds an epoch guard.
+  while (pendingTaskCount > 0 || pendingMeshJobCount > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
 }
 
 void WorldManager::updateCameraPosition(const glm::vec3 &cameraPosition) {
@@ -74,113 +208,226 @@ void WorldManager::gameLoop() {
 
       glm::vec3 cameraPos = getCurrentCameraPosition();
 
-      glm::ivec3 cameraChunk =
-          glm::ivec3(floor(cameraPos.x / 16.0f), floor(cameraPos.y / 16.0f),
-                     floor(cameraPos.z / 16.0f));
+      glm::ivec3 cameraChunk = worldToChunk(cameraPos);
+      glm::ivec3 loadCenter = getLoadCenter(cameraChunk);
 
-      unloadDistantChunks(cameraChunk);
-      pruneOutOfRangeLoadingChunks(cameraChunk);
-      queueChunksForLoading(cameraChunk, cameraPos);
+      unloadDistantChunks(loadCenter);
+      reclaimer.collect();
+      updateFarField(cameraChunk);
+      updateLevelsOfDetail(cameraChunk);
+      queueChunksForLoading(loadCenter, cameraPos);
     }
 
     std::this_thread::sleep_for(std::chrono::milliseconds(1));
   }
 }
 
-void WorldManager::unloadDistantChunks(const glm::ivec3 &cameraChunk) {
-  std::vector<glm::ivec3> chunksToUnload;
-
-  {
-    std::shared_lock<std::shared_mutex> lock(chunk_map_mutex);
+// Calls f for every position in [min, max] outside [exMin, exMax]. Rows
+// inside the excluded box on x and y only visit their two z ends, so the
+// cost follows the output rather than the box.
+template <typename F>
+static void forEachOutside(const glm::ivec3 &min, const glm::ivec3 &max,
+                           const glm::ivec3 &exMin, const glm::ivec3 &exMax,
+                           F &&f) {
+  for (int x = min.x; x <= max.x; ++x) {
+    bool xInside = x >= exMin.x && x <= exMax.x;
+    for (int y = min.y; y <= max.y; ++y) {
+      if (!xInside || y < exMin.y || y > exMax.y) {
+        for (int z = min.z; z <= max.z; ++z)
+          f(glm::ivec3(x, y, z));
+        continue;
+      }
+      for (int z = min.z; z <= std::min(max.z, exMin.z - 1); ++z)
+        f(glm::ivec3(x, y, z));
+      for (int z = std::max(min.z, exMax.z + 1); z <= max.z; ++z)
+        f(glm::ivec3(x, y, z));
+    }
+  }
+}
 
-    for (const auto &[pos, chunk] : chunk_map) {
-      int dx = std::abs(pos.x - cameraChunk.x);
-      int dy = std::abs(pos.y - cameraChunk.y);
-      int dz = std::abs(pos.z - cameraChunk.z);
-      int maxDist = std::max({dx, dy, dz});
+// Moves the chunk grid's window to loadCenter. Nothing outside the window
+// is ever loaded, so only the shell of positions leaving it can hold chunks
+// to unload.
+void WorldManager::unloadDistantChunks(const glm::ivec3 &loadCenter) {
+  // Only this thread moves the window.
+  if (chunkGrid.hasOrigin() && chunkGrid.getOrigin() == loadCenter)
+    return;
 
-      if (maxDist > RENDER_DISTANCE + 4) {
-        chunksToUnload.push_back(pos);
-      }
+  std::vector<Chunk *> unloaded;
+  {
+    std::unique_lock<std::shared_mutex> lock(chunk_map_mutex);
+    if (chunkGrid.hasOrigin()) {
+      glm::ivec3 oldMin, oldMax, newMin, newMax;
+      chunkGrid.getWindow(chunkGrid.getOrigin(), oldMin, oldMax);
+      chunkGrid.getWindow(loadCenter, newMin, newMax);
+      forEachOutside(oldMin, oldMax, newMin, newMax,
+                     [&](const glm::ivec3 &pos) {
+                       Chunk *chunk = chunkGrid.get(pos);
+                       if (chunk == nullptr)
+                         return;
+                       unloadChunk(chunk);
+                       unloaded.push_back(chunk);
+                     });
     }
+    chunkGrid.setOrigin(loadCenter);
   }
 
-  for (const auto &pos : chunksToUnload) {
-    unloadChunk(pos);
+  for (Chunk *chunk : unloaded) {
+    chunkRegistry.deactivate(chunk->registrySlot);
+    retireChunk(chunk);
   }
 }
 
-void WorldManager::pruneOutOfRangeLoadingChunks(const glm::ivec3 &cameraChunk) {
-  std::vector<glm::ivec3> chunksToPrune;
+void WorldManager::updateFarField(const glm::ivec3 &cameraChunk) {
+  std::vector<Chunk *> toCompact;
+  std::vector<Chunk *> toExpand;
 
   {
-    std::lock_guard<std::mutex> lock(loadingMutex);
-    for (const auto &chunkPos : chunksLoading) {
-      glm::ivec3 diff = chunkPos - cameraChunk;
-      int horizontalDist = std::max(std::abs(diff.x), std::abs(diff.z));
+    std::shared_lock<std::shared_mutex> lock(chunk_map_mutex);
 
-      if (horizontalDist > RENDER_DISTANCE + 2 ||
-          chunkPos.y < cameraChunk.y - 4 - 2 ||
-          chunkPos.y > cameraChunk.y + 7 + 2) {
-        chunksToPrune.push_back(chunkPos);
+    chunkGrid.forEach([&](Chunk *chunk) {
+      const glm::ivec3 &pos = chunk->chunkPosition;
+      int horizontalDist = std::max(std::abs(pos.x - cameraChunk.x),
+                                    std::abs(pos.z - cameraChunk.z));
+
+      if (chunk->isCompact()) {
+        if (horizontalDist < FAR_FIELD_DISTANCE)
+          toExpand.push_back(chunk);
+      } else if (horizontalDist > FAR_FIELD_DISTANCE &&
+                 chunk->state.status == ChunkState::IDLE &&
+                 !chunk->isUniform()) {
+        // Only once the mesh is uploaded; a chunk still waiting on its
+        // neighbors would just be decoded again for every remesh.
+        toCompact.push_back(chunk);
       }
-    }
+    });
+  }
 
-    for (const auto &pos : chunksToPrune) {
-      chunksLoading.erase(pos);
-      chunksProcessed.insert(pos);
+  // Only this thread unloads and frees chunks, so the pointers stay valid
+  // without the map lock held through the conversions.
+  for (Chunk *chunk : toExpand)
+    chunk->expandVoxels();
+  for (Chunk *chunk : toCompact)
+    chunk->compactVoxels();
+}
+
+int WorldManager::getLodLevelForDistance(int horizontalDist) {
+  int level = 0;
+  while (level < MAX_LOD_LEVEL && horizontalDist >= LOD_DISTANCE[level])
+    ++level;
+  return level;
+}
+
+void WorldManager::updateLevelsOfDetail(const glm::ivec3 &cameraChunk) {
+  std::shared_lock<std::shared_mutex> lock(chunk_map_mutex);
+
+  chunkGrid.forEach([&](Chunk *chunk) {
+    const glm::ivec3 &pos = chunk->chunkPosition;
+    int horizontalDist = std::max(std::abs(pos.x - cameraChunk.x),
+                                  std::abs(pos.z - cameraChunk.z));
+    int current = chunk->getLodLevel();
+    int level = getLodLevelForDistance(horizontalDist);
+    // Finer as soon as the chunk crosses a boundary, coarser only once it
+    // is a chunk past it.
+    if (level > current)
+      level = std::max(current, getLodLevelForDistance(horizontalDist - 1));
+    if (level != current)
+      chunk->setLodLevel(level);
+
+    // Only an idle chunk is queued from here. One being meshed picks the
+    // new level up when its job finishes (see Chunk::generateMesh); one
+    // flagged just as its upload went IDLE is caught on a later tick.
+    if (chunk->getMeshNeedsUpdate()) {
+      ChunkState idle = ChunkState::IDLE;
+      chunk->state.status.compare_exchange_strong(
+          idle, ChunkState::WAITING_FOR_MESH_UPDATE);
     }
-  }
+  });
+}
 
-  if (!chunksToPrune.empty()) {
-    std::cout << "Pruned " << chunksToPrune.size()
-              << " out-of-range chunks from loading queue" << std::endl;
-  }
+void WorldManager::getLoadBox(const glm::ivec3 &loadCenter, glm::ivec3 &min,
+                              glm::ivec3 &max) {
+  const int maxTerrainChunkY = (MAX_HEIGHT / CHUNK_HEIGHT) + 1;
+  min = loadCenter - glm::ivec3(RENDER_DISTANCE, LOAD_BELOW, RENDER_DISTANCE);
+  max = loadCenter + glm::ivec3(RENDER_DISTANCE, LOAD_ABOVE, RENDER_DISTANCE);
+  max.y = std::min(max.y, maxTerrainChunkY);
 }
 
-void WorldManager::queueChunksForLoading(const glm::ivec3 &cameraChunk,
+// Only does work when the camera crosses into another chunk, a load task
+// gave up, or the backlog still holds positions the pending-task limit
+// held back. A move schedules just the shell of positions entering the
+// load box and drops the backlog's positions that left it; load tasks
+// already running check the range themselves.
+void WorldManager::queueChunksForLoading(const glm::ivec3 &loadCenter,
                                          const glm::vec3 &cameraPos) {
-  std::vector<ChunkLoadTask> tasksToLoad;
-  int maxTerrainChunkY = (MAX_HEIGHT / CHUNK_HEIGHT) + 1;
+  const bool moved =
+      !hasScheduledLoadCenter || loadCenter != scheduledLoadCenter;
+  const bool retry = hasLoadRetries.exchange(false);
+  if (!moved && !retry && loadBacklog.empty())
+    return;
 
-  int totalQueued = 0;
-  for (const auto &offset : loadingOffsets) {
-    glm::ivec3 chunkPos = cameraChunk + offset;
+  glm::ivec3 boxMin, boxMax;
+  getLoadBox(loadCenter, boxMin, boxMax);
+  auto inBox = [&](const glm::ivec3 &p) {
+    return glm::all(glm::greaterThanEqual(p, boxMin)) &&
+           glm::all(glm::lessThanEqual(p, boxMax));
+  };
 
-    if (chunkPos.y > maxTerrainChunkY)
-      continue;
+  std::vector<glm::ivec3> entering;
+  std::vector<glm::ivec3> retries;
+  std::vector<glm::ivec3> leaving;
+  if (moved) {
+    // Nothing scheduled yet: the excluded box is empty.
+    glm::ivec3 oldMin(1), oldMax(0);
+    if (hasScheduledLoadCenter)
+      getLoadBox(scheduledLoadCenter, oldMin, oldMax);
+    forEachOutside(boxMin, boxMax, oldMin, oldMax,
+                   [&](const glm::ivec3 &p) { entering.push_back(p); });
+    scheduledLoadCenter = loadCenter;
+    hasScheduledLoadCenter = true;
+
+    auto left = std::partition(loadBacklog.begin(), loadBacklog.end(), inBox);
+    leaving.assign(left, loadBacklog.end());
+    loadBacklog.erase(left, loadBacklog.end());
+  }
 
-    {
-      std::lock_guard<std::mutex> lock(loadingMutex);
-      if (chunksProcessed.find(chunkPos) != chunksProcessed.end()) {
-        continue;
-      }
-      if (chunksLoading.find(chunkPos) != chunksLoading.end()) {
+  {
+    // Backlogged positions are QUEUED too, which keeps them from being
+    // scheduled twice.
+    std::lock_guard<std::mutex> lock(loadingMutex);
+    if (retry)
+      retries.swap(loadRetries);
+    for (const glm::ivec3 &p : leaving)
+      loadStates.set(p, ChunkLoadState::UNKNOWN);
+    for (const glm::ivec3 &p : retries)
+      if (inBox(p))
+        entering.push_back(p);
+    for (const glm::ivec3 &p : entering) {
+      if (loadStates.get(p) != ChunkLoadState::UNKNOWN)
         continue;
-      }
-
-      chunksLoading.insert(chunkPos);
+      loadStates.set(p, ChunkLoadState::QUEUED);
+      loadBacklog.push_back(p);
+    }
+    // Whatever unloadDistantChunks has let go of can be forgotten.
+    if (moved) {
+      glm::ivec3 keepMin, keepMax;
+      chunkGrid.getWindow(loadCenter, keepMin, keepMax);
+      loadStates.releaseOutside(keepMin, keepMax);
     }
-
-    tasksToLoad.push_back({chunkPos});
-    totalQueued++;
   }
 
-  if (totalQueued == 0)
-    return;
-
-  std::sort(tasksToLoad.begin(), tasksToLoad.end(),
-            [&cameraPos](const ChunkLoadTask &a, const ChunkLoadTask &b) {
-              return a.getDistance(cameraPos) < b.getDistance(cameraPos);
-            });
+  // Nearest last, where it is taken from.
+  if (moved || !entering.empty())
+    std::sort(loadBacklog.begin(), loadBacklog.end(),
+              [&cameraPos](const glm::ivec3 &a, const glm::ivec3 &b) {
+                return ChunkLoadTask{a}.getDistance(cameraPos) >
+                       ChunkLoadTask{b}.getDistance(cameraPos);
+              });
 
   size_t tasksSubmitted = 0;
-  for (const auto &task : tasksToLoad) {
-    if (pendingTaskCount >= MAX_PENDING_TASKS) {
-      std::lock_guard<std::mutex> lock(loadingMutex);
-      chunksLoading.erase(task.position);
-      continue;
-    }
+  while (!loadBacklog.empty() && pendingTaskCount < MAX_PENDING_TASKS) {
+    ChunkLoadTask task{loadBacklog.back()};
+    loadBacklog.pop_back();
 
     pendingTaskCount++;
     tasksSubmitted++;
@@ -191,195 +438,146 @@ void WorldManager::queueChunksForLoading(const glm::ivec3 &cameraChunk,
         Guard(std::atomic<int> &cnt) : c(cnt) {}
         ~Guard() { c--; }
       } guard(pendingTaskCount);
+      // Keeps the chunk loaded here, and the neighbors it links to,
+      // allocated until the task is done, even if they are unloaded.
+      EpochReclaimer::Guard pinned = reclaimer.pin();
 
       glm::vec3 currentCamPos = getCurrentCameraPosition();
 
-      glm::ivec3 currentCameraChunk = glm::ivec3(
-          floor(currentCamPos.x / 16.0f), floor(currentCamPos.y / 16.0f),
-          floor(currentCamPos.z / 16.0f));
+      glm::ivec3 currentCameraChunk =
+          getLoadCenter(worldToChunk(currentCamPos));
       glm::ivec3 diff = task.position - currentCameraChunk;
       int horizontalDist = std::max(std::abs(diff.x), std::abs(diff.z));
 
       if (horizontalDist > RENDER_DISTANCE + 2 ||
-          task.position.y < currentCameraChunk.y - 4 - 2 ||
-          task.position.y > currentCameraChunk.y + 7 + 2) {
-        {
-          std::lock_guard<std::mutex> lock(loadingMutex);
-          chunksLoading.erase(task.position);
-          chunksProcessed.insert(task.position);
-        }
+          task.position.y < currentCameraChunk.y - LOAD_BELOW - 2 ||
+          task.position.y > currentCameraChunk.y + LOAD_ABOVE + 2) {
+        abandonLoad(task.position, true);
         return;
       }
 
-      Chunk *chunk = new Chunk(task.position);
-      bool isEmpty = true;
-
-      if (task.position.y > 0) {
-        float persistence = 0.5f;
-        float lacunarity = 2.0f;
-        int octaves = 4;
-
-        float initialFrequency = 0.005f;
-
-        int heightMap [CHUNK_WIDTH][CHUNK_DEPTH];
-        for (int x = 0; x < CHUNK_WIDTH; ++x) {
-          for (int z = 0; z < CHUNK_DEPTH; ++z) {
-            float worldX = x + chunk->chunkPosition.x * CHUNK_WIDTH;
-            float worldZ = z + chunk->chunkPosition.z * CHUNK_DEPTH;
-            float amplitude = 1.0f;
-            float totalNoise = 0.0f;
-            float amplitudeSum = 0.0f;
-            float frequency = initialFrequency;
-
-            for (int i = 0; i < octaves; ++i) {
-              float perlinValue = glm::perlin(glm::vec2(worldX, worldZ) * frequency);
-              totalNoise += perlinValue * amplitude;
-              amplitudeSum += amplitude;
-
-              amplitude *= persistence;
-              frequency *= lacunarity;
-            }
-
-            float normalizedNoise = (amplitudeSum > 0.0f) ? (totalNoise / amplitudeSum) : 0.0f;
-            normalizedNoise = glm::clamp(normalizedNoise, -1.0f, 1.0f);
-
-            heightMap[x][z] = static_cast<int>(((normalizedNoise + 1.0f) / 2.0f) * MAX_HEIGHT);
-          }
-        }
-
-
-        for (int x = 0; x < CHUNK_WIDTH; ++x){
-          for (int z = 0; z < CHUNK_DEPTH; ++z){
-            int height = heightMap[x][z];
-            for (int y = 0; y < CHUNK_HEIGHT; ++y){
-              int worldY = y + chunk->chunkPosition.y * CHUNK_HEIGHT;
-              if (worldY < height){
-                chunk->setVoxel(x, y, z, Voxel::GREEN);//Voxel::GREEN); // Solid voxel
-                isEmpty = false;
-              }
-            }
-          }
-        }
-
-      } else {
-        float noiseMap[CHUNK_WIDTH][CHUNK_HEIGHT][CHUNK_DEPTH];
-        for (int x = 0; x < CHUNK_WIDTH; ++x) {
-          for (int y = 0; y < CHUNK_HEIGHT; ++y) {
-            for (int z = 0; z < CHUNK_DEPTH; ++z) {
-              float worldX = x + chunk->chunkPosition.x * CHUNK_WIDTH;
-              float worldY = y + chunk->chunkPosition.y * CHUNK_HEIGHT;
-              float worldZ = z + chunk->chunkPosition.z * CHUNK_DEPTH;
-              float noisevalue = glm::perlin(glm::vec3(worldX, worldY, worldZ) * 0.01f);
-                          
-              noiseMap[x][y][z] = glm::clamp((noisevalue + 1.0f) / 2.0f, 0.0f, 1.0f);
-            }
-          }
-        }
-        
-        for (int x = 0; x < CHUNK_WIDTH; ++x) {
-          for (int y = 0; y < CHUNK_HEIGHT; ++y) {
-            float gradient = 0.0f;
-            if (task.position.y > -1) {
-              gradient = y * 0.02f;
-            } else if (task.position.y > -2){
-              gradient = (y - 16.0f) * 0.01f;
-            }
-            for (int z = 0; z < CHUNK_DEPTH; ++z) {
-              float density = noiseMap[x][y][z];
-              if (task.position.y > -2) {
-                if (density > 0.4f - gradient) {
-                  chunk->setVoxel(x, y, z, Voxel::GREEN); // Solid voxel
-                  isEmpty = false;
-                } else {
-                  chunk->setVoxel(x, y, z, 0); // Air voxel
-                }
-              } else {
-                if (density > 0.565f){
-                  chunk->setVoxel(x, y, z, Voxel::GREEN); // Solid voxel
-                  isEmpty = false;
-                } else {
-                  chunk->setVoxel(x, y, z, 0); // Air voxel
-                }
-              }
-            }
-          }
-        }
+      // The slot is taken before the terrain is generated, so a full
+      // registry drops the task before it does any work. It is tried again
+      // later, by when unloads may have freed some slots.
+      uint32_t slot = chunkRegistry.allocate();
+      if (slot == ChunkRegistry::INVALID_SLOT) {
+        abandonLoad(task.position, true);
+        return;
       }
 
+      // Generated into a private buffer and published once, so the chunk's
+      // first visible version is complete terrain. Empty chunks never get a
+      // Chunk, and hand their slot straight back.
+      ChunkVoxels voxels;
+      bool isEmpty = !generateTerrain(task.position, voxels);
+
       if (isEmpty) {
-        {
-          std::lock_guard<std::mutex> lock(loadingMutex);
-          chunksLoading.erase(task.position);
-          chunksProcessed.insert(task.position);
-        }
-        delete chunk;
+        chunkRegistry.releaseUnused(slot);
+        abandonLoad(task.position, false);
         return;
       }
-      chunk->status = ChunkState::WAITING_FOR_MESH_UPDATE;
 
       {
-        std::unique_lock<std::shared_mutex> lock(chunk_map_mutex);
-        chunk_map[task.position] = chunk;
-        onChunkLoaded(chunk);
+        // The grid's window has moved off the position since the check
+        // above; the scheduler drops it if it is out of range for good.
+        std::shared_lock<std::shared_mutex> lock(chunk_map_mutex);
+        if (!chunkGrid.contains(task.position)) {
+          chunkRegistry.releaseUnused(slot);
+          abandonLoad(task.position, true);
+          return;
+        }
       }
 
-      // Add to both parallel arrays atomically under one lock.
-      {
-        std::unique_lock<std::shared_mutex> lock(activeChunksMutex);
-        activeChunks.push_back(chunk);
-        activeChunkWorldPos.push_back(glm::vec3(chunk->chunkPosition) * 16.0f);
-      }
+      Chunk *chunk = chunkPool.acquire(task.position, slot,
+                                       chunkRegistry.getState(slot));
+      chunk->publishVoxels(std::move(voxels));
+      chunk->setLodLevel(getLodLevelForDistance(horizontalDist));
+      chunk->state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
 
-      chunk->generateMesh();
-
-      // Queue neighbor updates
-      glm::ivec3 pos = chunk->chunkPosition;
-      glm::ivec3 neighborOffsets[6] = {
-          pos + glm::ivec3(1, 0, 0), pos + glm::ivec3(-1, 0, 0),
-          pos + glm::ivec3(0, 1, 0), pos + glm::ivec3(0, -1, 0),
-          pos + glm::ivec3(0, 0, 1), pos + glm::ivec3(0, 0, -1)};
-
-      for (const auto &neighborPos : neighborOffsets) {
-        {
-          std::shared_lock<std::shared_mutex> lock(chunk_map_mutex);
-          auto it = chunk_map.find(neighborPos);
-          if (it != chunk_map.end() && it->second != nullptr) {
-            it->second->setMeshNeedsUpdate();
-            it->second->status = ChunkState::WAITING_FOR_MESH_UPDATE;
-          }
+      // Loads only exclude the window moving, not each other: the grid
+      // slot is claimed atomically, and onChunkLoaded copes with a
+      // neighbor being linked at the same time.
+      bool inserted;
+      {
+        std::shared_lock<std::shared_mutex> lock(chunk_map_mutex);
+        inserted = chunkGrid.insert(chunk);
+        if (inserted) {
+          onChunkLoaded(chunk);
+          std::lock_guard<std::mutex> loadingLock(loadingMutex);
+          loadStates.set(task.position, ChunkLoadState::LOADED);
         }
       }
-
-      {
-        std::lock_guard<std::mutex> lock(loadingMutex);
-        chunksLoading.erase(task.position);
-        chunksLoaded.insert(task.position);
-        chunksProcessed.insert(task.position);
+      if (!inserted) {
+        // Lost a race with the window moving: never visible, so it goes
+        // straight to the delete queue.
+        retireChunk(chunk);
+        abandonLoad(task.position, true);
+        return;
       }
+
+      chunkRegistry.activate(slot, chunk);
+
+      // Its neighbors were told in onChunkLoaded.
+      meshChunk(chunk);
     });
   }
 
-  if (tasksSubmitted > 0 && tasksSubmitted < tasksToLoad.size()) {
+  if (tasksSubmitted > 0 && !loadBacklog.empty()) {
     std::cout << "Queue limited: submitted " << tasksSubmitted << " of "
-              << tasksToLoad.size() << " pending chunks" << std::endl;
+              << tasksSubmitted + loadBacklog.size() << " pending chunks"
+              << std::endl;
   }
 }
 
-void WorldManager::queueMeshUpdate(Chunk *chunk) {
-  chunk->status = ChunkState::GENERATING;
-  updatePool->enqueue([chunk]() {
-    chunk->generateMesh();
+void WorldManager::abandonLoad(const glm::ivec3 &position, bool retry) {
+  std::lock_guard<std::mutex> lock(loadingMutex);
+  loadStates.set(position,
+                 retry ? ChunkLoadState::UNKNOWN : ChunkLoadState::EMPTY);
+  if (retry) {
+    loadRetries.push_back(position);
+    hasLoadRetries = true;
+  }
+}
+
+void WorldManager::queueMeshUpdate(Chunk *chunk,
+                                   const EpochReclaimer::Guard &pinned) {
+  chunk->state.status = ChunkState::GENERATING;
+  pendingMeshJobCount++;
+  updatePool->enqueue([chunk, guard = EpochReclaimer::Guard(pinned),
+                       this]() mutable {
+    meshChunk(chunk);
+    // Counted as done only once the guard is gone (see stop).
+    guard.release();
+    pendingMeshJobCount--;
   });
 }
 
+// Called with an epoch pinned, which keeps the chunk and any neighbor it
+// is linked to allocated, unloaded or not. Their current voxel buffers are
+// pinned in turn, and copying the borders and meshing run on those
+// immutable buffers.
+void WorldManager::meshChunk(Chunk *chunk) {
+  if (chunk->state.markedForDeletion.load(std::memory_order_acquire))
+    return;
+  if (!chunk->getMeshNeedsUpdate()) {
+    chunk->skipMeshJob();
+    return;
+  }
+
+  static thread_local ChunkMeshInput input;
+  chunk->generateMesh(input, &meshCache,
+                      isSmoothTerrain() ? &WorldManager::terrainDensity
+                                        : nullptr);
+}
+
 int WorldManager::getLoadedChunkCount() const {
   std::lock_guard<std::mutex> lock(const_cast<std::mutex &>(loadingMutex));
-  return chunksLoaded.size();
+  return (int)loadStates.getCount(ChunkLoadState::LOADED);
 }
 
 int WorldManager::getLoadingChunkCount() const {
   std::lock_guard<std::mutex> lock(const_cast<std::mutex &>(loadingMutex));
-  return chunksLoading.size();
+  return (int)loadStates.getCount(ChunkLoadState::QUEUED);
 }
 
 void WorldManager::onChunkLoaded(Chunk *chunk) {
@@ -397,92 +595,114 @@ void WorldManager::onChunkLoaded(Chunk *chunk) {
   const int opposite[6] = {1, 0, 3, 2, 5, 4};
 
   for (int dir = 0; dir < 6; ++dir) {
-    glm::ivec3 neighborPos = pos + offsets[dir];
-    auto it = chunk_map.find(neighborPos);
-
-    if (it != chunk_map.end() && it->second != nullptr) {
-      Chunk *neighbor = it->second;
+    Chunk *neighbor = chunkGrid.get(pos + offsets[dir]);
 
+    if (neighbor != nullptr) {
       chunk->setNeighbor(dir, neighbor);
       neighbor->setNeighbor(opposite[dir], chunk);
 
-      neighbor->setMeshNeedsUpdate();
-      neighbor->status = ChunkState::WAITING_FOR_MESH_UPDATE;
+      // Only the neighbor's boundary slice facing chunk can change.
+      neighborChanged(neighbor, opposite[dir], chunk->getBoundaryFill(dir));
     }
   }
-}
-
-void WorldManager::unloadChunk(const glm::ivec3 &pos) {
-  Chunk *chunkToDelete = nullptr;
 
-  {
-    std::unique_lock<std::shared_mutex> lock(chunk_map_mutex);
+  for (const glm::ivec3 &offset : DIAGONAL_OFFSETS) {
+    Chunk *diagonal = chunkGrid.get(pos + offset);
 
-    auto it = chunk_map.find(pos);
-    if (it == chunk_map.end() || it->second == nullptr) {
-      return;
+    if (diagonal != nullptr) {
+      chunk->setDiagonalNeighbor(offset, diagonal);
+      diagonal->setDiagonalNeighbor(-offset, chunk);
+      diagonalChanged(diagonal, -offset, chunk);
     }
+  }
+}
 
-    chunkToDelete = it->second;
+// A smooth mesh has no boundary slices, and its cells along the boundary
+// straddle both chunks, so anything solid appearing or vanishing there
+// remeshes the whole chunk.
+void WorldManager::neighborChanged(Chunk *chunk, int direction,
+                                   BoundaryFill neighborFill) {
+  if (!isSmoothTerrain()) {
+    chunk->neighborBoundaryChanged(direction, neighborFill);
+    return;
+  }
+  if (neighborFill == BoundaryFill::EMPTY)
+    return;
+  chunk->setMeshNeedsUpdate();
+  chunk->state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
+}
 
-    const glm::ivec3 offsets[6] = {glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0),
-                                   glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0),
-                                   glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)};
-    const int opposite[6] = {1, 0, 3, 2, 5, 4};
+// Edge and corner cells only feed block occlusion; smooth meshes take
+// those points from the density.
+void WorldManager::diagonalChanged(Chunk *chunk, const glm::ivec3 &offset,
+                                   const Chunk *diagonal) {
+  if (isSmoothTerrain() || !diagonal->hasSolidEdge(-offset))
+    return;
+  chunk->diagonalBoundaryChanged(offset);
+}
 
-    for (int dir = 0; dir < 6; ++dir) {
-      glm::ivec3 neighborPos = pos + offsets[dir];
-      auto neighborIt = chunk_map.find(neighborPos);
+void WorldManager::setSmoothTerrain(bool smooth) {
+  if (smoothTerrain.exchange(smooth) == smooth)
+    return;
+  std::shared_lock<std::shared_mutex> lock(chunk_map_mutex);
+  chunkGrid.forEach([](Chunk *chunk) {
+    chunk->setMeshNeedsUpdate();
+    chunk->state.status = ChunkState::WAITING_FOR_MESH_UPDATE;
+  });
+}
 
-      if (neighborIt != chunk_map.end() && neighborIt->second != nullptr) {
-        Chunk *neighbor = neighborIt->second;
+void WorldManager::unloadChunk(Chunk *chunk) {
+  glm::ivec3 pos = chunk->chunkPosition;
 
-        neighbor->clearNeighbor(opposite[dir]);
+  const glm::ivec3 offsets[6] = {glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0),
+                                 glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0),
+                                 glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)};
+  const int opposite[6] = {1, 0, 3, 2, 5, 4};
 
-        neighbor->setMeshNeedsUpdate();
-        neighbor->status = ChunkState::WAITING_FOR_MESH_UPDATE;
-      }
-    }
+  for (int dir = 0; dir < 6; ++dir) {
+    Chunk *neighbor = chunkGrid.get(pos + offsets[dir]);
 
-    chunkToDelete->clearAllNeighbors();
+    if (neighbor != nullptr) {
+      neighbor->clearNeighbor(opposite[dir]);
 
-    chunk_map.erase(it);
-    chunksLoaded.erase(pos);
+      // Its boundary slice facing the unloaded chunk now sees air.
+      neighborChanged(neighbor, opposite[dir], chunk->getBoundaryFill(dir));
+    }
   }
 
-  {
-    // Remove from both parallel arrays using the swap-and-pop idiom.
-    // This is O(n) for the find but O(1) for the removal itself,
-    // matching the original behaviour while keeping arrays in sync.
-    std::unique_lock<std::shared_mutex> lock(activeChunksMutex);
-    auto itVec = std::find(activeChunks.begin(), activeChunks.end(), chunkToDelete);
-    if (itVec != activeChunks.end()) {
-      size_t idx = std::distance(activeChunks.begin(), itVec);
-
-      // Swap-and-pop both arrays together so indices stay aligned.
-      activeChunks[idx]        = activeChunks.back();
-      activeChunkWorldPos[idx] = activeChunkWorldPos.back();
-      activeChunks.pop_back();
-      activeChunkWorldPos.pop_back();
+  for (const glm::ivec3 &offset : DIAGONAL_OFFSETS) {
+    Chunk *diagonal = chunkGrid.get(pos + offset);
+
+    if (diagonal != nullptr) {
+      diagonal->clearDiagonalNeighbor(-offset);
+      diagonalChanged(diagonal, -offset, chunk);
     }
   }
 
-  chunkToDelete->markedForDeletion.store(true, std::memory_order_release);
-  {
-    std::lock_guard<std::mutex> del_lock(delete_queue_mutex);
-    chunksToDelete.push_back(chunkToDelete);
-  }
+  chunk->clearAllNeighbors();
+
+  chunkGrid.erase(pos);
+  std::lock_guard<std::mutex> loadingLock(loadingMutex);
+  loadStates.set(pos, ChunkLoadState::UNKNOWN);
+}
+
+void WorldManager::retireChunk(Chunk *chunk) {
+  chunk->state.markedForDeletion.store(true, std::memory_order_release);
+  reclaimer.retire([this, chunk]() {
+    // The registry slot outlives its chunk: it still holds the GL buffers.
+    uint32_t slot = chunk->registrySlot;
+    chunkPool.release(chunk);
+    std::lock_guard<std::mutex> lock(release_queue_mutex);
+    slotsToRelease.push_back(slot);
+  });
 }
 
 void WorldManager::cleanUpDeletedChunks() {
-  std::vector<Chunk *> toDelete;
+  std::vector<uint32_t> slots;
   {
-    std::lock_guard<std::mutex> lock(delete_queue_mutex);
-    toDelete = std::move(chunksToDelete);
-    chunksToDelete.clear();
-  }
-
-  for (Chunk *chunk : toDelete) {
-    delete chunk;
+    std::lock_guard<std::mutex> lock(release_queue_mutex);
+    slots.swap(slotsToRelease);
   }
+  for (uint32_t slot : slots)
+    chunkRegistry.release(slot);
 }
\ No newline at end of file
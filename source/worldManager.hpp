@@ -1,31 +1,26 @@
 #pragma once
 
 #include "chunk.hpp"
+#include "chunkGrid.hpp"
+#include "chunkLoadTable.hpp"
+#include "chunkPool.hpp"
+#include "chunkRegistry.hpp"
+#include "epochReclaimer.hpp"
+#include "meshCache.hpp"
 #include "threadPool.hpp"
 #include <atomic>
 #include <glm/glm.hpp>
-#include <map>
 #include <mutex>
 #include <queue>
-#include <set>
 #include <shared_mutex>
 #include <vector>
 
-struct ivec3Compare {
-  bool operator()(const glm::ivec3 &a, const glm::ivec3 &b) const {
-    if (a.x != b.x)
-      return a.x < b.x;
-    if (a.y != b.y)
-      return a.y < b.y;
-    return a.z < b.z;
-  }
-};
-
 struct ChunkLoadTask {
   glm::ivec3 position;
 
   float getDistance(const glm::vec3 &cameraPos) const {
-    glm::vec3 chunkWorldPos = glm::vec3(position) * 16.0f + glm::vec3(8.0f);
+    glm::vec3 chunkWorldPos = glm::vec3(position) * (float)CHUNK_SIZE +
+                              glm::vec3(CHUNK_SIZE / 2.0f);
     return glm::length(chunkWorldPos - cameraPos);
   }
 
@@ -38,22 +33,27 @@ public:
   ~WorldManager();
 
   void start(ThreadPool *loadingThreadPool, ThreadPool *updateThreadPool);
+  // Stops the game thread and waits for the load and mesh tasks already
+  // handed to the pools, which still use the chunks.
   void stop();
   void updateCameraPosition(const glm::vec3 &cameraPosition);
+  // Releases the registry slots of freed chunks, in one batch per frame:
+  // their GL buffers have to be deleted on the render thread.
   void cleanUpDeletedChunks();
 
-  ChunkMap &getChunkMap() { return chunk_map; }
+  ChunkGrid &getChunkGrid() { return chunkGrid; }
   std::shared_mutex &getChunkMapMutex() { return chunk_map_mutex; }
 
-  // --- Culling interface ---
-  // activeChunks and activeChunkWorldPos are parallel arrays kept in sync.
-  // The culling loop reads only activeChunkWorldPos (hot floats, no pointer
-  // chasing) and looks up activeChunks[i] only for chunks that pass the frustum.
-  const std::vector<Chunk *>    &getActiveChunks()        const { return activeChunks; }
-  const std::vector<glm::vec3>  &getActiveChunkWorldPos() const { return activeChunkWorldPos; }
-  std::shared_mutex             &getActiveChunksMutex()   const { return activeChunksMutex; }
+  // --- Culling / render interface ---
+  // The render loop culls on the registry's cull positions and draws from
+  // its render records; it only reaches a Chunk to queue or upload a mesh.
+  // A chunk whose slot it finds active stays allocated while it holds a
+  // guard from getReclaimer().pin().
+  ChunkRegistry &getChunkRegistry() { return chunkRegistry; }
+  EpochReclaimer &getReclaimer() { return reclaimer; }
 
-  void queueMeshUpdate(Chunk *chunk);
+  // chunk must have been reached under pinned; the mesh task keeps a copy.
+  void queueMeshUpdate(Chunk *chunk, const EpochReclaimer::Guard &pinned);
 
   int getLoadedChunkCount() const;
   int getLoadingChunkCount() const;
@@ -61,39 +61,97 @@ public:
 
   glm::vec3 getCurrentCameraPosition() const;
 
+  const ChunkPool &getChunkPool() const { return chunkPool; }
+  const MeshCache &getMeshCache() const { return meshCache; }
+
+  // Smooth terrain meshes the world with SurfaceNets instead of the greedy
+  // block mesher. Switching remeshes every loaded chunk.
+  void setSmoothTerrain(bool smooth);
+  bool isSmoothTerrain() const {
+    return smoothTerrain.load(std::memory_order_relaxed);
+  }
+
 private:
-  void unloadDistantChunks(const glm::ivec3 &cameraChunk);
-  void queueChunksForLoading(const glm::ivec3 &cameraChunk,
+  void unloadDistantChunks(const glm::ivec3 &loadCenter);
+  void updateFarField(const glm::ivec3 &cameraChunk);
+  void updateLevelsOfDetail(const glm::ivec3 &cameraChunk);
+  // Level of detail for a chunk horizontalDist chunks from the camera.
+  static int getLodLevelForDistance(int horizontalDist);
+  // Chunk positions to load around loadCenter: [min, max] inclusive.
+  void getLoadBox(const glm::ivec3 &loadCenter, glm::ivec3 &min,
+                  glm::ivec3 &max);
+  void queueChunksForLoading(const glm::ivec3 &loadCenter,
                              const glm::vec3 &cameraPos);
-  void pruneOutOfRangeLoadingChunks(const glm::ivec3 &cameraChunk);
-
+  // A load task that won't load position marks it EMPTY, or with retry
+  // hands it back to the scheduler, which loads it again if it is still in
+  // range.
+  void abandonLoad(const glm::ivec3 &position, bool retry);
+
+  void meshChunk(Chunk *chunk);
+
+  static glm::ivec3 worldToChunk(const glm::vec3 &worldPos);
+  // Chunk the load box and the chunk grid are centered on: the camera's,
+  // lowered to at most LOAD_BELOW so the band below it still reaches the
+  // lowest surface (y = 0). However high the camera flies, the terrain it
+  // looks down on stays loaded.
+  static glm::ivec3 getLoadCenter(const glm::ivec3 &cameraChunk);
+  static bool generateTerrain(const glm::ivec3 &chunkPos, ChunkVoxels &voxels);
+  // Heightmap surface over world column (x, z), in voxels; the voxels
+  // below its integer part are solid.
+  static float terrainHeight(float worldX, float worldZ);
+  // Cave noise at worldVoxel minus the solid threshold at its height.
+  static float caveDensity(const glm::ivec3 &worldVoxel);
+  // The terrain as a continuous field for smooth meshing (see SurfaceNets):
+  // positive in solid voxels, negative in empty ones.
+  static float terrainDensity(const glm::ivec3 &worldVoxel);
+  // Tells chunk that its neighbor in direction was linked or unlinked.
+  void neighborChanged(Chunk *chunk, int direction, BoundaryFill neighborFill);
+  // Tells chunk that diagonal, its edge or corner neighbor at offset, was
+  // linked or unlinked.
+  void diagonalChanged(Chunk *chunk, const glm::ivec3 &offset,
+                       const Chunk *diagonal);
+
+  // Links chunk, just inserted into the grid, with its neighbors; runs
+  // with chunk_map_mutex held shared. Two neighbors loaded at once may
+  // both link each other, which is harmless.
   void onChunkLoaded(Chunk *chunk);
-  void unloadChunk(const glm::ivec3 &pos);
-
-  ChunkMap chunk_map;
+  // Unlinks chunk and takes it out of the grid; runs with chunk_map_mutex
+  // held exclusively, so no load links to it meanwhile.
+  void unloadChunk(Chunk *chunk);
+  // Hands a chunk no longer in the grid to the reclaimer. Once freed, its
+  // registry slot waits for cleanUpDeletedChunks.
+  void retireChunk(Chunk *chunk);
+
+  ChunkPool chunkPool;
+  ChunkRegistry chunkRegistry;
+  MeshCache meshCache;
+  ChunkGrid chunkGrid;
   std::shared_mutex chunk_map_mutex;
 
-  std::vector<glm::ivec3> loadingOffsets;
-  void initLoadingOffsets();
-
-  // Parallel arrays — always kept in sync under activeChunksMutex.
-  // activeChunkWorldPos[i] == glm::vec3(activeChunks[i]->chunkPosition) * 16.f
-  // Keeping world positions in a flat float array gives the culling loop
-  // sequential cache-friendly access without touching the large Chunk objects.
-  std::vector<Chunk *>   activeChunks;
-  std::vector<glm::vec3> activeChunkWorldPos;
-  mutable std::shared_mutex activeChunksMutex;
-
-  std::vector<Chunk *> chunksToDelete;
-  std::mutex delete_queue_mutex;
-
-  std::set<glm::ivec3, ivec3Compare> chunksLoading;
-  std::set<glm::ivec3, ivec3Compare> chunksLoaded;
-  std::set<glm::ivec3, ivec3Compare> chunksProcessed;
+  // Load scheduling, game thread only: the center the load box was
+  // last built around, and the positions in it still waiting for a load
+  // task, nearest last.
+  glm::ivec3 scheduledLoadCenter{0};
+  bool hasScheduledLoadCenter = false;
+  std::vector<glm::ivec3> loadBacklog;
+
+  // Frees unloaded chunks on the game thread once no load or mesh task,
+  // and no frame, can still be using them.
+  EpochReclaimer reclaimer;
+  std::vector<uint32_t> slotsToRelease;
+  std::mutex release_queue_mutex;
+
+  // Load state of the positions around the camera.
+  ChunkLoadTable loadStates;
+  // Handed back by abandonLoad(..., true) for the scheduler to look at.
+  std::vector<glm::ivec3> loadRetries;
   mutable std::mutex loadingMutex;
+  std::atomic<bool> hasLoadRetries{false};
 
   std::atomic<bool> running{false};
+  std::atomic<bool> smoothTerrain{false};
   std::atomic<int> pendingTaskCount{0};
+  std::atomic<int> pendingMeshJobCount{0};
 
   glm::vec3 currentCameraPosition{0.0f};
   mutable std::mutex cameraPosMutex;
@@ -101,6 +159,32 @@ private:
   ThreadPool *loadingPool = nullptr;
   ThreadPool *updatePool = nullptr;
 
+  // Vertical load band around the camera chunk, in chunks; 64 voxels below
+  // and MAX_HEIGHT above whatever CHUNK_SIZE is.
+  static constexpr int LOAD_BELOW = 64 / CHUNK_HEIGHT;
+  static constexpr int LOAD_ABOVE = MAX_HEIGHT / CHUNK_HEIGHT;
+  // Chunks further than this (horizontally, in chunks) keep their voxels
+  // as a BrickMap once meshed; they go back to dense storage one chunk
+  // closer, so a camera on the boundary doesn't convert back and forth.
+  static constexpr int FAR_FIELD_DISTANCE = 128 / CHUNK_SIZE;
+  // A chunk is meshed at level L + 1 once it is LOD_DISTANCE[L] or more
+  // chunks away (horizontally): every voxel out to 128 voxels, then 2x, 4x
+  // and 8x blocks out to 256, 512 and beyond. A chunk only goes coarser one
+  // chunk past the boundary, so a camera on it doesn't remesh back and
+  // forth.
+  static constexpr int LOD_DISTANCE[MAX_LOD_LEVEL] = {
+      128 / CHUNK_SIZE, 256 / CHUNK_SIZE, 512 / CHUNK_SIZE};
+  // World y where the heightmap surface starts; caves are generated below it.
+  static constexpr int TERRAIN_CAVE_TOP = 16;
+
+  // Loaded chunks stay until they are this many chunks outside the load
+  // box horizontally, so one moving back and forth isn't reloaded;
+  // vertically, until they leave the band load tasks still accept. This is
+  // the chunk grid's window, centered like the load box (see
+  // getLoadCenter).
+  static constexpr int UNLOAD_MARGIN = 4;
+  static constexpr int UNLOAD_MARGIN_Y = 2;
+
   const int RENDER_DISTANCE;
   const int MAX_PENDING_TASKS = 32 * 32 * 32;
 